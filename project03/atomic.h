@@ -0,0 +1,228 @@
+// Atomic operations and memory fences for user programs.
+// Include after types.h, e.g.
+//
+//   #include "types.h"
+//   #include "user.h"
+//   #include "atomic.h"
+//
+// Threads created by thread_create share one address space and may run
+// on different CPUs at the same time, so plain ++ on shared data is not
+// safe.  Everything here is a static inline wrapper around a single
+// lock-prefixed x86 instruction (or a cmpxchg retry loop where x86 has
+// no instruction that returns the old value).
+
+// Compiler barrier: stop gcc from moving memory accesses across it.
+// Generates no instructions.
+static inline void
+barrier(void)
+{
+  asm volatile("" : : : "memory");
+}
+
+// Full memory fence.  A locked add to the stack orders all earlier
+// loads and stores before all later ones, like mfence, but also works
+// on CPUs without SSE2.
+static inline void
+mb(void)
+{
+  asm volatile("lock; addl $0,0(%%esp)" : : : "memory", "cc");
+}
+
+// x86 never reorders loads with loads or stores with stores, so read
+// and write fences only need to stop the compiler.
+static inline void
+rmb(void)
+{
+  barrier();
+}
+
+static inline void
+wmb(void)
+{
+  barrier();
+}
+
+// Spin-wait hint.  Call in the body of busy-wait loops: it saves power
+// and frees the pipeline for the other hyperthread.
+static inline void
+cpu_relax(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
+// Atomically: if *addr == expected, store newval.
+// Returns the value *addr held before; success iff it equals expected.
+static inline uint
+cmpxchg(volatile uint *addr, uint expected, uint newval)
+{
+  uint prev;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (prev), "+m" (*addr) :
+               "r" (newval), "0" (expected) :
+               "memory", "cc");
+  return prev;
+}
+
+// Atomically store newval into *addr and return the old value.
+static inline uint
+atomic_xchg(volatile uint *addr, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; xchgl %0, %1" :
+               "+m" (*addr), "=a" (result) :
+               "1" (newval) :
+               "memory", "cc");
+  return result;
+}
+
+// Atomically add v to *addr and return the old value.
+static inline uint
+fetch_and_add(volatile uint *addr, uint v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return v;
+}
+
+// Atomically or v into *addr and return the old value.
+static inline uint
+fetch_and_or(volatile uint *addr, uint v)
+{
+  uint old;
+
+  do {
+    old = *addr;
+  } while(cmpxchg(addr, old, old | v) != old);
+  return old;
+}
+
+// Atomically and v into *addr and return the old value.
+static inline uint
+fetch_and_and(volatile uint *addr, uint v)
+{
+  uint old;
+
+  do {
+    old = *addr;
+  } while(cmpxchg(addr, old, old & v) != old);
+  return old;
+}
+
+// Compare-and-swap on a pointer.  Returns 1 if *addr was expected
+// and now holds newval, 0 otherwise.
+static inline int
+cas_ptr(void * volatile *addr, void *expected, void *newval)
+{
+  return cmpxchg((volatile uint*)addr, (uint)expected, (uint)newval) ==
+         (uint)expected;
+}
+
+//PAGEBREAK!
+// Typed counters, for refcounts and statistics shared between threads.
+// Wrapping the int in a struct keeps it from being used with ordinary
+// (non-atomic) arithmetic by mistake.
+
+typedef struct {
+  volatile int counter;
+} atomic_t;
+
+#define ATOMIC_INIT(i)  { (i) }
+
+static inline int
+atomic_read(atomic_t *a)
+{
+  return a->counter;
+}
+
+static inline void
+atomic_set(atomic_t *a, int i)
+{
+  a->counter = i;
+}
+
+// Add i and return the new value.
+static inline int
+atomic_add_return(atomic_t *a, int i)
+{
+  return (int)fetch_and_add((volatile uint*)&a->counter, (uint)i) + i;
+}
+
+static inline int
+atomic_sub_return(atomic_t *a, int i)
+{
+  return atomic_add_return(a, -i);
+}
+
+static inline void
+atomic_inc(atomic_t *a)
+{
+  asm volatile("lock; incl %0" : "+m" (a->counter) : : "memory", "cc");
+}
+
+static inline void
+atomic_dec(atomic_t *a)
+{
+  asm volatile("lock; decl %0" : "+m" (a->counter) : : "memory", "cc");
+}
+
+// Decrement and return 1 if the result is zero, e.g. to decide who
+// frees an object when dropping the last reference.
+static inline int
+atomic_dec_and_test(atomic_t *a)
+{
+  uchar zero;
+
+  asm volatile("lock; decl %0; sete %1" :
+               "+m" (a->counter), "=qm" (zero) :
+               :
+               "memory", "cc");
+  return zero != 0;
+}
+
+// If the counter equals expected, set it to newval.
+// Returns the value it held before.
+static inline int
+atomic_cmpxchg(atomic_t *a, int expected, int newval)
+{
+  return (int)cmpxchg((volatile uint*)&a->counter, (uint)expected,
+                      (uint)newval);
+}
+
+//PAGEBREAK!
+// A test-and-test-and-set spinlock for user threads.  Spins on a plain
+// read so that waiting CPUs do not bounce the cache line with locked
+// writes, and uses pause between reads.
+
+typedef struct {
+  volatile uint locked;
+} uspinlock_t;
+
+#define USPINLOCK_INIT  { 0 }
+
+static inline void
+uspin_lock(uspinlock_t *lk)
+{
+  while(atomic_xchg(&lk->locked, 1) != 0){
+    while(lk->locked)
+      cpu_relax();
+  }
+}
+
+static inline int
+uspin_trylock(uspinlock_t *lk)
+{
+  return atomic_xchg(&lk->locked, 1) == 0;
+}
+
+static inline void
+uspin_unlock(uspinlock_t *lk)
+{
+  // A plain store releases on x86; the barrier keeps the compiler
+  // from sinking critical-section stores below it.
+  barrier();
+  lk->locked = 0;
+}
@@ -0,0 +1,139 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "atomic.h"
+
+#define NUM_THREAD 8
+#define NUM_ITERS 100000
+
+thread_t thread[NUM_THREAD];
+
+uspinlock_t lock = USPINLOCK_INIT;
+int locked_counter;
+volatile uint xadd_counter;
+volatile uint cas_counter;
+volatile uint bits;
+atomic_t refs = ATOMIC_INIT(0);
+atomic_t lost = ATOMIC_INIT(0);
+
+void failed()
+{
+  printf(1, "Test failed!\n");
+  exit();
+}
+
+void *thread_lock(void *arg)
+{
+  int i;
+
+  for (i = 0; i < NUM_ITERS; i++) {
+    uspin_lock(&lock);
+    locked_counter++;
+    uspin_unlock(&lock);
+  }
+  thread_exit(arg);
+  return 0;
+}
+
+void *thread_xadd(void *arg)
+{
+  int i;
+
+  for (i = 0; i < NUM_ITERS; i++) {
+    fetch_and_add(&xadd_counter, 1);
+    atomic_inc(&refs);
+  }
+  thread_exit(arg);
+  return 0;
+}
+
+void *thread_cas(void *arg)
+{
+  int i;
+  uint old;
+
+  for (i = 0; i < NUM_ITERS; i++) {
+    do {
+      old = cas_counter;
+    } while (cmpxchg(&cas_counter, old, old + 1) != old);
+  }
+  thread_exit(arg);
+  return 0;
+}
+
+// Each thread sets and clears its own bit.  A lost update from another
+// thread would show up as the bit not being what this thread left it.
+void *thread_bits(void *arg)
+{
+  uint bit = 1 << (int)arg;
+  int i;
+
+  for (i = 0; i < NUM_ITERS; i++) {
+    if (fetch_and_or(&bits, bit) & bit)
+      atomic_inc(&lost);
+    if (!(fetch_and_and(&bits, ~bit) & bit))
+      atomic_inc(&lost);
+  }
+  thread_exit(arg);
+  return 0;
+}
+
+void run_all(void *(*entry)(void *))
+{
+  int i, retval;
+
+  for (i = 0; i < NUM_THREAD; i++) {
+    if (thread_create(&thread[i], entry, (void *)i) != 0) {
+      printf(1, "Error creating thread %d\n", i);
+      failed();
+    }
+  }
+  for (i = 0; i < NUM_THREAD; i++) {
+    if (thread_join(thread[i], (void **)&retval) != 0) {
+      printf(1, "Error joining thread %d\n", i);
+      failed();
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  uint total = NUM_THREAD * NUM_ITERS;
+
+  printf(1, "Test 1: uspinlock test\n");
+  run_all(thread_lock);
+  if (locked_counter != total) {
+    printf(1, "Counter is %d, but expected %d\n", locked_counter, total);
+    failed();
+  }
+  printf(1, "Test 1 passed\n\n");
+
+  printf(1, "Test 2: xadd test\n");
+  run_all(thread_xadd);
+  if (xadd_counter != total || atomic_read(&refs) != total) {
+    printf(1, "Counters are %d and %d, but expected %d\n",
+           xadd_counter, atomic_read(&refs), total);
+    failed();
+  }
+  printf(1, "Test 2 passed\n\n");
+
+  printf(1, "Test 3: cmpxchg test\n");
+  run_all(thread_cas);
+  if (cas_counter != total) {
+    printf(1, "Counter is %d, but expected %d\n", cas_counter, total);
+    failed();
+  }
+  printf(1, "Test 3 passed\n\n");
+
+  printf(1, "Test 4: fetch_and_or/and test\n");
+  run_all(thread_bits);
+  if (bits != 0 || atomic_read(&lost) != 0) {
+    printf(1, "Bits are %x with %d lost updates, but expected 0\n",
+           bits, atomic_read(&lost));
+    failed();
+  }
+  printf(1, "Test 4 passed\n\n");
+
+  printf(1, "All tests passed!\n");
+  exit();
+}
@@ -81,6 +81,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapicipi(uchar, int);
 void            microdelay(int);
 
 // log.c
@@ -123,6 +124,7 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int		thread_create(thread_t *thread, void *(start_routine)(void *), void *arg);
+int		thread_create_n(thread_t *threads, int n, void *(start_routine)(void *), void **args);
 void		thread_exit(void *retval);
 int		thread_join(thread_t thread, void **retval);
 
@@ -6,10 +6,12 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "traps.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct tgroup tgroup[NPROC];
 } ptable;
 
 static struct proc *initproc;
@@ -17,12 +19,15 @@ static struct proc *initproc;
 int nextpid = 1;
 int nexttid = 1;
 int thread_cnt = 0;
-uint sp;
-int stack_st[NPROC * 30];
 extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static int initkstack(struct proc *p);
+static struct tgroup* tgalloc(struct proc *leader);
+static void tgkill(struct tgroup *tg, struct proc *except);
+static void tgreap(struct tgroup *tg);
+static void tgsetsz(struct tgroup *tg, uint sz);
 
 void
 pinit(void)
@@ -78,7 +83,6 @@ static struct proc*
 allocproc(void)
 {
   struct proc *p;
-  char *sp;
 
   acquire(&ptable.lock);
 
@@ -92,14 +96,30 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->isThread = 0;
+  p->tg = 0;
+  p->tgnext = 0;
 
   release(&ptable.lock);
 
-  // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
+  if(initkstack(p) < 0){
     p->state = UNUSED;
     return 0;
   }
+  return p;
+}
+
+// Allocate p's kernel stack and set it up to start
+// executing at forkret, which returns to trapret.
+// Returns -1 if out of memory.
+static int
+initkstack(struct proc *p)
+{
+  char *sp;
+
+  // Allocate kernel stack.
+  if((p->kstack = kalloc()) == 0)
+    return -1;
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -116,7 +136,7 @@ found:
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
 
-  return p;
+  return 0;
 }
 
 //PAGEBREAK: 32
@@ -152,6 +172,7 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
+  p->tg = tgalloc(p);
   p->state = RUNNABLE;
 
   release(&ptable.lock);
@@ -165,15 +186,25 @@ growproc(int n)
   uint sz;
   struct proc *curproc = myproc();
 
+  // Threads share the address space, so they share its size too.
+  // Hold ptable.lock from reading sz to publishing the new one, so
+  // that another thread's sbrk or thread_create cannot use the same
+  // range at the same time.
+  acquire(&ptable.lock);
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&ptable.lock);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      release(&ptable.lock);
       return -1;
+    }
   }
-  curproc->sz = sz;
+  tgsetsz(curproc->tg, sz);
+  release(&ptable.lock);
   switchuvm(curproc);
   return 0;
 }
@@ -218,6 +249,7 @@ fork(void)
 
   acquire(&ptable.lock);
 
+  np->tg = tgalloc(np);
   np->state = RUNNABLE;
 
   release(&ptable.lock);
@@ -233,6 +265,7 @@ exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
+  struct tgroup *tg;
   int fd;
 
   if(curproc == initproc)
@@ -253,8 +286,20 @@ exit(void)
 
   acquire(&ptable.lock);
 
-  // Parent might be sleeping in wait().
+  // The first member of a thread group to exit takes the rest of
+  // the group down with it.
+  tg = curproc->tg;
+  if(!tg->exiting){
+    tg->exiting = 1;
+    tgkill(tg, curproc);
+  }
+
+  // Parent might be sleeping in wait(), or in thread_join()
+  // if we are a thread.  The leader's parent can only reap the
+  // group once its last member is gone.
   wakeup1(curproc->parent);
+  if(--tg->nlive == 0)
+    wakeup1(tg->leader->parent);
 
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
@@ -285,20 +330,14 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      // Threads are reaped with their group, not on their own.
+      if(p->parent != curproc || p->isThread)
         continue;
       havekids = 1;
-      if(p->state == ZOMBIE){
+      if(p->state == ZOMBIE && p->tg->nlive == 0){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        tgreap(p->tg);
         release(&ptable.lock);
         return pid;
       }
@@ -487,11 +526,16 @@ kill(int pid)
 
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+    if(p->pid == pid && p->state != UNUSED){
+      // Threads share the pid of their process; kill all of them.
+      if(p->tg)
+        tgkill(p->tg, 0);
+      else {
+        p->killed = 1;
+        // Wake process from sleep if necessary.
+        if(p->state == SLEEPING)
+          p->state = RUNNABLE;
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -537,122 +581,277 @@ procdump(void)
   }
 }
 
+//PAGEBREAK!
+// Thread groups.
+
+// Allocate a thread group led by leader.
+// Caller must hold ptable.lock.
+static struct tgroup*
+tgalloc(struct proc *leader)
+{
+  struct tgroup *tg;
+
+  // There is at most one group per proc, so this cannot fail.
+  for(tg = ptable.tgroup; tg < &ptable.tgroup[NPROC]; tg++){
+    if(tg->leader == 0){
+      tg->leader = leader;
+      tg->members = leader;
+      tg->nlive = 1;
+      tg->exiting = 0;
+      tg->nfreestack = 0;
+      leader->tgnext = 0;
+      return tg;
+    }
+  }
+  panic("tgalloc");
+}
+
+// Mark every member of tg except except as killed, in one pass
+// over the group.  Members running on other CPUs are interrupted
+// so that they exit now instead of at their next timer tick.
+// Caller must hold ptable.lock.
+static void
+tgkill(struct tgroup *tg, struct proc *except)
+{
+  struct proc *p;
+  struct cpu *c;
+
+  for(p = tg->members; p; p = p->tgnext){
+    if(p == except)
+      continue;
+    p->killed = 1;
+    // Wake member from sleep if necessary.
+    if(p->state == SLEEPING)
+      p->state = RUNNABLE;
+  }
+
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c != mycpu() && c->proc && c->proc != except && c->proc->tg == tg)
+      lapicipi(c->apicid, T_KILLIPI);
+  }
+}
+
+// Free a proc slot whose kernel stack is no longer in use.
+// Does not touch the shared address space.
+static void
+freeproc(struct proc *p)
+{
+  if(p->kstack)
+    kfree(p->kstack);
+  p->kstack = 0;
+  p->pgdir = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->isThread = 0;
+  p->tid = 0;
+  p->tg = 0;
+  p->tgnext = 0;
+  p->ustack = 0;
+  p->state = UNUSED;
+}
+
+// Reap a thread group whose members have all exited: free every
+// member and, exactly once, the page table they shared.
+// Caller must hold ptable.lock.
+static void
+tgreap(struct tgroup *tg)
+{
+  struct proc *p, *next;
+
+  if(tg->nlive != 0)
+    panic("tgreap");
+  freevm(tg->leader->pgdir);
+  for(p = tg->members; p; p = next){
+    next = p->tgnext;
+    freeproc(p);
+  }
+  tg->members = 0;
+  tg->exiting = 0;
+  tg->leader = 0;
+}
+
+// Record a new size of the address space shared by tg, and forget
+// free thread stacks that are no longer inside it.
+// Caller must hold ptable.lock.
+static void
+tgsetsz(struct tgroup *tg, uint sz)
+{
+  struct proc *p;
+  int i;
+
+  for(p = tg->members; p; p = p->tgnext)
+    p->sz = sz;
+  for(i = 0; i < tg->nfreestack; ){
+    if(tg->freestack[i] + 2*PGSIZE > sz)
+      tg->freestack[i] = tg->freestack[--tg->nfreestack];
+    else
+      i++;
+  }
+}
+
+// Remove a joined thread from its group.
+// Caller must hold ptable.lock.
+static void
+tgunlink(struct proc *t)
+{
+  struct proc **pp;
+
+  for(pp = &t->tg->members; *pp; pp = &(*pp)->tgnext){
+    if(*pp == t){
+      *pp = t->tgnext;
+      t->tgnext = 0;
+      return;
+    }
+  }
+  panic("tgunlink");
+}
 
 int
 thread_create(thread_t *thread, void *(*start_routine)(void *), void *arg)
 {
-    int i;
-    struct proc *np;
+    return thread_create_n(thread, 1, start_routine, &arg);
+}
+
+// n개의 thread를 한 번에 만든다.
+// ptable.lock은 한 번만 잡고, n개의 user stack은 한 번의 allocuvm으로
+// 할당한 뒤 TLB flush도 한 번만 한다.
+// threads[i]에 i번째 thread의 tid를 쓰고, i번째 thread는 args[i]를
+// 인자로 start_routine에서 시작한다.
+int
+thread_create_n(thread_t *threads, int n, void *(*start_routine)(void *), void **args)
+{
+    int i, k, fd;
+    struct proc *p, *np[NPROC];
     struct proc *curproc = myproc();
-    uint stack_size, sp, u_stack[2];
-    int have_lock = 0;
+    struct tgroup *tg = curproc->tg;
+    uint stack_size, base, sz, sp, u_stack[2];
+    int reuse;
 
-    // Allocate process.
-    if ((np = allocproc()) == 0) {
+    if (n <= 0 || n > NPROC)
         return -1;
-    }
 
-    // 프로세스 구조체 초기화하기
-    np->sz = curproc->sz;
-    np->pgdir = curproc->pgdir;
-    np->parent = curproc;
-    np->pid = curproc->pid;
-    np->isThread = 1;
-    np->tid = nexttid++;
-    np->cwd = idup(curproc->cwd);
-    safestrcpy(np->name, curproc->name, sizeof(curproc->name));
-
-    // Copy trap frame
-    *np->tf = *curproc->tf;
+    acquire(&ptable.lock);
 
-    *thread = np->tid;
+    // 그룹이 이미 종료 중이면 새 thread를 만들지 않는다
+    if (tg->exiting) {
+        release(&ptable.lock);
+        return -1;
+    }
 
-    // 스택에 대한 할당처리를 위해서 lock
-    pushcli();
-    acquire(&ptable.lock);
-    have_lock = 1;
-
-    // Find an available stack
-    for (i = 0; i < NPROC * 30; i++) {
-        if (!stack_st[i]) {
-            stack_st[i] = 1;
-            np->kstack_id = i;
-            break;
+    // ptable을 한 번만 훑어서 빈 slot n개를 잡는다
+    k = 0;
+    for (p = ptable.proc; p < &ptable.proc[NPROC] && k < n; p++) {
+        if (p->state == UNUSED) {
+            p->state = EMBRYO;
+            p->kstack = 0;
+            np[k++] = p;
         }
     }
+    if (k < n)
+        goto bad;
 
-    // page size는 2를 곱해서 적용 -> 보호 페이지 부여
-    np->kstack = (char *)curproc->kstack + (2 * PGSIZE * np->kstack_id);
+    for (i = 0; i < n; i++) {
+        if (initkstack(np[i]) < 0)
+            goto bad;
+    }
 
-    // 스택에 할당하기
+    // join된 thread의 스택을 먼저 다시 쓰고, 모자라는 것만 현재 주소
+    // 공간 끝에 한 번에 할당하기 (thread마다 보호 페이지 포함 2 page)
     stack_size = 2 * PGSIZE;
-    uint stack_bottom = curproc->sz;
-
-    cprintf("pgdir: %p\n", np->pgdir);
-    cprintf("np->kstack: %p\n", np->kstack);
-    cprintf("stack_size: %d\n", stack_size);
-    cprintf("stack_bottom: %p\n", stack_bottom);
-
-    // 현재 프로세스의 스택 끝 부분에 새로운 스택 할당
-    if ((allocuvm(np->pgdir, stack_bottom, stack_bottom + stack_size)) == 0) {
-        //cprintf("!!");
-        np->state = UNUSED;
-        if (have_lock){
-          release(&ptable.lock);
-          have_lock = 0;
-          popcli();
+    reuse = n < tg->nfreestack ? n : tg->nfreestack;
+    sz = curproc->sz;
+    base = PGROUNDUP(sz);
+    if (reuse < n &&
+        (sz = allocuvm(curproc->pgdir, base, base + (n - reuse) * stack_size)) == 0)
+        goto bad;
+
+    for (i = 0; i < n; i++) {
+        p = np[i];
+
+        // 프로세스 구조체 초기화하기
+        p->pgdir = curproc->pgdir;
+        p->parent = curproc;
+        p->pid = curproc->pid;
+        p->isThread = 1;
+        p->tid = nexttid++;
+        safestrcpy(p->name, curproc->name, sizeof(curproc->name));
+
+        // Copy trap frame
+        *p->tf = *curproc->tf;
+
+        if (i < reuse)
+            p->ustack = tg->freestack[tg->nfreestack - 1 - i];
+        else
+            p->ustack = base + (i - reuse) * stack_size;
+
+        // 스택 아래쪽 page는 보호 페이지
+        clearpteu(curproc->pgdir, (char *)p->ustack);
+        sp = p->ustack + stack_size;
+
+        u_stack[0] = 0xffffffff; // 가짜 리턴 address
+        u_stack[1] = (uint)args[i];
+
+        sp -= sizeof(u_stack);
+        if (copyout(curproc->pgdir, sp, u_stack, sizeof(u_stack)) < 0) {
+            deallocuvm(curproc->pgdir, sz, curproc->sz);
+            goto bad;
         }
-        return -1;
-    }
 
-    clearpteu(np->pgdir, (char *)(stack_bottom + stack_size));
-
-    sp = stack_bottom + stack_size;
+        p->tf->esp = sp;
+        p->tf->eip = (uint)start_routine;
+    }
 
-    u_stack[0] = 0xffffffff; // 가짜 리턴 address
-    u_stack[1] = (uint)arg;
+    // 보호 페이지 PTE 변경 사항을 한 번의 flush로 반영
+    lcr3(V2P(curproc->pgdir));
 
-    sp -= sizeof(u_stack);
-    if (copyout(np->pgdir, sp, u_stack, sizeof(u_stack)) < 0) {
-        np->state = UNUSED;
-        cprintf("1");
-        if (have_lock){
-          release(&ptable.lock);
-          have_lock = 0;
-          popcli();
+    for (i = 0; i < n; i++) {
+        p = np[i];
+        for (fd = 0; fd < NOFILE; fd++) {
+            if (curproc->ofile[fd]) {
+                p->ofile[fd] = filedup(curproc->ofile[fd]);
+            }
         }
-        return -1;
-    }
+        p->cwd = idup(curproc->cwd);
 
-    cprintf("2");
-    np->tf->esp = sp;
-    np->tf->eip = (uint)start_routine;
+        // thread group에 추가
+        p->tg = tg;
+        p->tgnext = tg->members;
+        tg->members = p;
+        tg->nlive++;
 
-    for (i = 0; i < NOFILE; i++) {
-        if (curproc->ofile[i]) {
-            np->ofile[i] = filedup(curproc->ofile[i]);
-        }
+        threads[i] = p->tid;
     }
+    tg->nfreestack -= reuse;
+    tgsetsz(tg, sz);
 
-    np->state = RUNNABLE;
-    curproc->tcnt++;
-    thread_cnt++;
+    for (i = 0; i < n; i++)
+        np[i]->state = RUNNABLE;
+    curproc->tcnt += n;
+    thread_cnt += n;
 
-    if (have_lock){
-          release(&ptable.lock);
-          have_lock = 0;
-          popcli();
-        }
+    release(&ptable.lock);
 
     return 0;
+
+bad:
+    for (i = 0; i < k; i++)
+        freeproc(np[i]);
+    release(&ptable.lock);
+    return -1;
 }
 
 void 
 thread_exit(void *retval)
 {
     struct proc *curproc = myproc();
+    struct tgroup *tg = curproc->tg;
+
+    // main thread가 끝나면 process 전체가 끝난다
+    if (!curproc->isThread)
+        exit();
 
-    cprintf("3\n");
     curproc->retval = retval;
 
     // 파일 닫기
@@ -663,39 +862,33 @@ thread_exit(void *retval)
         }
     }
 
-    pushcli();
-    acquire(&ptable.lock);
-
-    cprintf("4\n");
-
     // 현재 디렉터리 해제
-    if (curproc->cwd) {
-        iput(curproc->cwd);
-        curproc->cwd = 0;
-    }
+    begin_op();
+    iput(curproc->cwd);
+    end_op();
+    curproc->cwd = 0;
 
-    // 부모 프로세스를 깨우기
-    if (curproc->parent && curproc->parent->state == SLEEPING && curproc->chan) {
-        curproc->parent->state = RUNNABLE;
-        curproc->chan = 0;
-    }
+    acquire(&ptable.lock);
+
+    // thread_join에서 기다리는 부모 프로세스를 깨우기
+    wakeup1(curproc->parent);
+    // 마지막 member라면 group을 reap할 leader의 부모를 깨우기
+    if (--tg->nlive == 0)
+        wakeup1(tg->leader->parent);
 
     curproc->state = ZOMBIE;
     curproc->parent->tcnt--;
     thread_cnt--;
 
-    release(&ptable.lock);
-    popcli();
-
     // 스케줄러 호출
     sched();
+    panic("zombie exit");
 }
 
 
 int
 thread_join(thread_t thread, void **retval)
 {
-    cprintf("3''");
     struct proc *curproc = myproc();
     struct proc *p;
 
@@ -704,49 +897,36 @@ thread_join(thread_t thread, void **retval)
         return -1;
     }
 
-    pushcli();
     acquire(&ptable.lock);
 
-    cprintf("4''");
-
     for (;;) {
-        // ptable에서 다음 process 찾기
-        for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-            // 스레드 ID, 스레드 상태, 부모 프로세스 ID가 일치하고 스레드가 ZOMBIE 상태인 경우
-            if (p->tid == thread && p->isThread && curproc->pid == p->pid && p->state == ZOMBIE) {
+        // 같은 thread group에서 해당 thread 찾기
+        for (p = curproc->tg->members; p; p = p->tgnext) {
+            // 스레드 ID가 일치하고 스레드가 ZOMBIE 상태인 경우
+            if (p->tid == thread && p->isThread && p->state == ZOMBIE) {
                 // 반환 값을 설정
                 *retval = p->retval;
 
-                // 자원을 해제
-                deallocuvm(p->pgdir, (uint)(p->kstack), (uint)(p->kstack) + 2 * PGSIZE);
-                kfree(p->kstack);
-                p->kstack = 0;
-                p->sz = 0;
-                p->state = UNUSED;
-                p->pid = 0;
-                p->parent = 0;
-                p->killed = 0;
-                p->isThread = 0;
-                p->tid = 0;
-                stack_st[p->kstack_id] = 0;
+                // 자원을 해제 (주소 공간은 group이 공유하므로 그대로 둔다).
+                // 스택은 다음 thread_create_n이 다시 쓰도록 남겨 둔다.
+                // slot 수는 동시에 살아 있던 thread 수를 넘지 않는다.
+                if (p->ustack)
+                    curproc->tg->freestack[curproc->tg->nfreestack++] = p->ustack;
+                tgunlink(p);
+                freeproc(p);
 
                 release(&ptable.lock);
-                return (int)p->retval;
+                return 0;
             }
         }
 
         // 프로세스가 종료된 경우
         if (curproc->killed) {
             release(&ptable.lock);
-            return (int)curproc->retval;
+            return -1;
         }
 
         // thread가 zombie가 아니면 sleep
         sleep(curproc, &ptable.lock);
     }
-
-    release(&ptable.lock);
-    popcli();
-
-    return -1;
 }
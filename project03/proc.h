@@ -35,6 +35,18 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// Thread group: the main thread of a process plus every thread it
+// created with thread_create.  All members share one pgdir, which is
+// freed exactly once, when the group is reaped after nlive drops to 0.
+struct tgroup {
+  struct proc *leader;         // Main thread; null if slot is free
+  struct proc *members;        // All members, linked through tgnext
+  int nlive;                   // Members not yet ZOMBIE
+  int exiting;                 // Group exit in progress
+  uint freestack[NPROC];       // Stacks of joined threads, for reuse
+  int nfreestack;
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -55,7 +67,9 @@ struct proc {
   int tid;                     // thread ID
   int tcnt;                    // thread count
   void *retval;                // return value 
-  int kstack_id;               // stack_id
+  struct tgroup *tg;           // Thread group this proc belongs to
+  struct proc *tgnext;         // Next member of tg
+  uint ustack;                 // Base of a thread's user stack (guard page)
 };
 
 // Process memory is laid out contiguously, low addresses first:
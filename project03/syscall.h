@@ -24,3 +24,4 @@
 #define SYS_thread_create 23
 #define SYS_thread_exit 24
 #define SYS_thread_join 25
+#define SYS_thread_create_n 26
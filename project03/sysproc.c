@@ -98,9 +98,10 @@ sys_uptime(void)
 int
 sys_thread_create(void)
 {
-    int thread, start_routine, arg;
+    int start_routine, arg;
+    thread_t *thread;
 
-    if ((argint(0, &thread) < 0))
+    if ((argptr(0, (char **)&thread, sizeof(thread_t)) < 0))
         return -1;
 
     if ((argint(1, &start_routine) < 0))
@@ -109,7 +110,29 @@ sys_thread_create(void)
     if ((argint(2, &arg) < 0))
         return -1;
 
-    return thread_create((thread_t *)&thread, (void *)start_routine, (void *)arg);
+    return thread_create(thread, (void *)start_routine, (void *)arg);
+}
+
+int
+sys_thread_create_n(void)
+{
+    int n, start_routine;
+    thread_t *threads;
+    void **args;
+
+    if ((argint(1, &n) < 0) || n <= 0 || n > NPROC)
+        return -1;
+
+    if ((argptr(0, (char **)&threads, n * sizeof(thread_t)) < 0))
+        return -1;
+
+    if ((argint(2, &start_routine) < 0))
+        return -1;
+
+    if ((argptr(3, (char **)&args, n * sizeof(void *)) < 0))
+        return -1;
+
+    return thread_create_n(threads, n, (void *)start_routine, args);
 }
 
 void
@@ -127,13 +150,13 @@ int
 sys_thread_join(void)
 {
     int thread;
-    int retval;
+    void **retval;
 
     if ((argint(0, &thread) < 0))
         return -1;
 
-    if ((argint(1, &retval) < 0))
+    if ((argptr(1, (char **)&retval, sizeof(void *)) < 0))
         return -1;
 
-    return thread_join((thread_t)thread, (void **)&retval);
-}
\ No newline at end of file
+    return thread_join((thread_t)thread, retval);
+}
@@ -7,6 +7,7 @@
 int status;
 thread_t thread[NUM_THREAD];
 int expected[NUM_THREAD];
+void *args[NUM_THREAD];
 
 void failed()
 {
@@ -27,6 +28,12 @@ void *thread_basic(void *arg)
   return 0;
 }
 
+void *thread_nop(void *arg)
+{
+  thread_exit(arg);
+  return 0;
+}
+
 void *thread_fork(void *arg)
 {
   int val = (int)arg;
@@ -128,7 +135,8 @@ void join_all(int n)
 
 int main(int argc, char *argv[])
 {
-  int i;
+  int i, k;
+  char *top;
   for (i = 0; i < NUM_THREAD; i++)
     expected[i] = i;
 
@@ -162,6 +170,36 @@ int main(int argc, char *argv[])
   join_all(NUM_THREAD);
   printf(1, "Test 3 passed\n\n");
 
+  printf(1, "Test 4: Batched create test\n");
+  status = 0;
+  for (i = 0; i < NUM_THREAD; i++)
+    args[i] = (void *)i;
+  if (thread_create_n(thread, NUM_THREAD, thread_basic, args) != 0) {
+    printf(1, "Error creating %d threads at once\n", NUM_THREAD);
+    failed();
+  }
+  join_all(NUM_THREAD);
+  if (status != 1) {
+    printf(1, "Join returned before thread exit, or the address space is not properly shared\n");
+    failed();
+  }
+  printf(1, "Test 4 passed\n\n");
+
+  printf(1, "Test 5: Stack reuse test\n");
+  top = sbrk(0);
+  for (k = 0; k < 10; k++) {
+    if (thread_create_n(thread, NUM_THREAD, thread_nop, args) != 0) {
+      printf(1, "Error creating %d threads at once\n", NUM_THREAD);
+      failed();
+    }
+    join_all(NUM_THREAD);
+  }
+  if (sbrk(0) != top) {
+    printf(1, "Joined threads' stacks were not reused\n");
+    failed();
+  }
+  printf(1, "Test 5 passed\n\n");
+
   printf(1, "All tests passed!\n");
   exit();
 }
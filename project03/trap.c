@@ -71,6 +71,11 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_KILLIPI:
+    // Another CPU is tearing down our thread group; the killed
+    // check below sends us to exit() if we were in user space.
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
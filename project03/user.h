@@ -28,6 +28,7 @@ int getgpid(void);
 int thread_create(thread_t *thread, void *(start_routine)(void *), void *arg);
 void thread_exit(void *retval);
 int thread_join(thread_t thread, void **retval);
+int thread_create_n(thread_t *threads, int n, void *(start_routine)(void *), void **args);
 
 
 // ulib.c
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,42 +17,111 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// Buffers are found through a hash table on (dev, blockno) with a
+// lock per bucket, so lookups of different blocks on different CPUs
+// do not wait for each other.  bcache.lock is only taken on a miss:
+// it keeps two CPUs from bringing in the same block twice and guards
+// the list of all buffers, which a clock hand goes round to find one
+// to recycle.  A buffer released since the hand last passed (used) is
+// given another round.  Lock order is bcache.lock, then one bucket
+// lock at a time.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "fs.h"
 #include "buf.h"
 
+#define NBUCKET 13
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;
+};
+
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct kmem_cache cache;
+  int nbuf;   // buffers allocated so far, at most NBUF
+
+  // List of all buffers, through next, and the clock hand in it.
+  struct buf *all;
+  struct buf *hand;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  struct bucket bucket[NBUCKET];
 } bcache;
 
 void
 binit(void)
 {
-  struct buf *b;
+  int i;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
 
-//PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // bget allocates buffers on demand.
+  kmem_cache_init(&bcache.cache, "buf", sizeof(struct buf));
+}
+
+static struct bucket*
+hash(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
+// Find the buffer for block blockno of dev in bk and take a
+// reference to it.  Caller holds bk->lock.
+static struct buf*
+lookup(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      return b;
+    }
+  }
+  return 0;
+}
+
+// Take an unused buffer out of its bucket for reuse, going round all
+// buffers like a clock.  Caller holds bcache.lock.
+static struct buf*
+recycle(void)
+{
+  struct buf *b, **pp;
+  struct bucket *bk;
+  int i;
+
+  for(i = 0; i < 2 * bcache.nbuf; i++){
+    b = bcache.hand;
+    if((bcache.hand = b->next) == 0)
+      bcache.hand = bcache.all;
+    // dev와 blockno는 bcache.lock 아래에서만 바뀐다
+    bk = hash(b->dev, b->blockno);
+    acquire(&bk->lock);
+    // Even if refcnt==0, B_DIRTY indicates a buffer is in use
+    // because log.c has modified it but not yet committed it.
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0){
+      if(b->used)
+        b->used = 0;
+      else {
+        for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+          ;
+        *pp = b->hnext;
+        release(&bk->lock);
+        return b;
+      }
+    }
+    release(&bk->lock);
   }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -61,35 +130,54 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *bk;
   struct buf *b;
 
-  acquire(&bcache.lock);
-
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  bk = hash(dev, blockno);
+  acquire(&bk->lock);
+  b = lookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    acquiresleep(&b->lock);
+    return b;
   }
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached.  Look again under bcache.lock, in case another CPU
+  // brought it in meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  b = lookup(bk, dev, blockno);
+  release(&bk->lock);
+  if(b){
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    return b;
   }
-  panic("bget: no buffers");
+
+  // Allocate a new buffer while under NBUF, else recycle one.
+  if(bcache.nbuf < NBUF && (b = kmem_cache_alloc(&bcache.cache)) != 0){
+    bcache.nbuf++;
+    initsleeplock(&b->lock, "buffer");
+    b->next = bcache.all;
+    bcache.all = b;
+    if(bcache.hand == 0)
+      bcache.hand = b;
+  } else if((b = recycle()) == 0)
+    panic("bget: no buffers");
+
+  b->dev = dev;
+  b->blockno = blockno;
+  b->flags = 0;
+  b->refcnt = 1;
+  b->used = 0;
+  acquire(&bk->lock);
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -116,28 +204,23 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Mark it used so that the clock passes it over once.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = hash(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
-  if (b->refcnt == 0) {
-    // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
-  
-  release(&bcache.lock);
+  if(b->refcnt == 0)
+    b->used = 1;
+  release(&bk->lock);
 }
 //PAGEBREAK!
 // Blank page.
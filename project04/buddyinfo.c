@@ -0,0 +1,28 @@
+// buddyinfo: print the kernel's free memory by buddy block order.
+// Many small blocks and no large ones means physical memory is
+// fragmented, and kalloc_pages/hsbrk may fail even with free pages.
+
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+int
+main(void)
+{
+  int nfree[MAXORDER+1];
+  int k, max, total, large;
+
+  max = buddyinfo(nfree);
+  total = large = 0;
+  for(k = 0; k <= MAXORDER; k++){
+    printf(1, "order %d (%d KB): %d\n", k, 4 << k, nfree[k]);
+    total += nfree[k] << k;
+    if(k == MAXORDER)
+      large = nfree[k] << k;
+  }
+  printf(1, "free pages %d, largest order %d\n", total, max);
+  // 4MB block에 들어 있지 않은 free page 비율
+  if(total > 0)
+    printf(1, "fragmented %d%%\n", (total - large) * 100 / total);
+  exit();
+}
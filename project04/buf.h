@@ -4,8 +4,9 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  int used;          // touched since the clock hand last passed
+  struct buf *hnext; // hash bucket chain
+  struct buf *next;  // list of all buffers, for the clock
   struct buf *qnext; // disk queue
   uchar data[BSIZE];
 };
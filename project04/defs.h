@@ -1,5 +1,7 @@
 struct buf;
 struct context;
+struct execimg;
+struct faulthist;
 struct file;
 struct inode;
 struct pipe;
@@ -7,6 +9,12 @@ struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct kmem_cache;
+struct memcount;
+struct spawn_action;
+struct victim;
+struct vma;
+struct vmstat;
 struct stat;
 struct superblock;
 
@@ -24,6 +32,10 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+int             loaduser(char*, char**, pde_t**, uint*, uint*, uint*, char*, int,
+                         struct execimg*);
+int             execfault(uint, int);
+int             execpage(struct proc*, uint);
 
 // file.c
 struct file*    filealloc(void);
@@ -40,6 +52,10 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iexecdup(struct inode*);
+void            iexecput(struct inode*);
+void            icacheinit(void);
+int             icacheshrink(int);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -72,6 +88,20 @@ int             get_refc(uint);
 int             countfp(void);
 void            incr_refc(uint);
 void            decr_refc(uint);
+int             put_page(uint);
+void            freepage(char*);
+char*           kalloc_pages(int);
+void            kfree_pages(char*, int);
+int             buddyinfo(int*);
+void            vmadd(int, uint);
+void            vmcount(int);
+void            vmstatsum(struct vmstat*);
+char*           hugealloc(void);
+char*           kzalloc(void);
+void            kzerofill(void);
+void            hugefree(char*);
+extern char*    zeropage;
+extern uint     phystop;
 
 
 // kbd.c
@@ -86,6 +116,11 @@ void            lapicinit(void);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
+// ksm.c
+void            ksminit(void);
+int             ksmctl(int);
+int             ksmscan(struct proc*, uint*, int);
+
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
@@ -100,18 +135,43 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pcache.c
+void            pcacheinit(void);
+char*           pcacheget(struct inode*, uint, uint);
+void            pcacheinval(struct inode*);
+int             pcacheshrink(int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
+void            pipeinit(void);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
 
+// mmap.c
+void            mmapinit(void);
+int             mmap(uint, int, int, int, struct file*, int);
+int             munmap(uint, int);
+int             mmapfault(uint, int);
+int             vmacopy(struct proc*, struct proc*);
+void            vmadup(struct vma*);
+void            vmafreeall(struct proc*);
+uint            vmalimit(struct proc*, uint, int);
+
 //PAGEBREAK: 16
 // proc.c
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
+int             vfork(void);
+void            vforkdone(struct proc*, uint, struct memcount*);
+int             spawn(char*, char**, struct spawn_action*);
 int             growproc(int);
+int             growhuge(int);
+struct proc*    kthread(char*, void (*)(void));
+int             swapvictims(struct victim*, int);
+int             procidle(struct proc*);
+void            ksmprocs(int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -126,6 +186,19 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
+// swap.c
+void            swapinit(void);
+int             swapalloc(void);
+void            swapdup(uint);
+void            swapput(uint);
+int             swapin(uint*);
+char*           kallocwait(int);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -156,6 +229,7 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argoutptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -169,6 +243,8 @@ void            idtinit(void);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
+void            countfault(int);
+void            faulthist(struct faulthist*, int);
 
 // uart.c
 void            uartinit(void);
@@ -181,10 +257,16 @@ void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
+int             hugeallocuvm(pde_t*, uint, uint);
+int             swapscan(struct proc*, uint*, struct victim*, int);
+int             mapuvm(pde_t*, uint, char*, int);
+int             copyrange(pde_t*, pde_t*, uint, uint, int);
+char*           nextdirty(pde_t*, uint*, uint);
+char*           nextpage(pde_t*, uint*, uint);
+void            prefault(char*, int, int);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
@@ -193,7 +275,10 @@ void            clearpteu(pde_t *pgdir, char *uva);
 int             countvp(void);
 int             countpp(void);
 int             countptp(void);
-void            CoW_handler(void);
+void            memrecount(struct proc*);
+void            memfork(struct proc*, struct proc*, int);
+int             CoW_handler(void);
+int             lazy_handler(int);
 
 
 // number of elements in fixed-size array
@@ -6,9 +6,20 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "vmstat.h"
 
+// Set up a fresh page table for the program at path and push argv
+// onto its user stack.  The program itself is not read in: its
+// segments are recorded in *exe, and execfault pages them in on
+// first touch.  path and argv must be readable in the current
+// address space.  On success fill in the new page table, size,
+// entry point, stack pointer, name (the last element of path, at
+// most namesz bytes) and *exe, which holds a reference to the
+// program's inode, and return 0.  Return -1 on error.
 int
-exec(char *path, char **argv)
+loaduser(char *path, char **argv, pde_t **pgdirp, uint *szp,
+         uint *entryp, uint *spp, char *name, int namesz,
+         struct execimg *exe)
 {
   char *s, *last;
   int i, off;
@@ -16,8 +27,8 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  struct execimg img;
+  pde_t *pgdir;
 
   begin_op();
 
@@ -28,6 +39,8 @@ exec(char *path, char **argv)
   }
   ilock(ip);
   pgdir = 0;
+  img.ip = 0;
+  img.nseg = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -38,7 +51,9 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm()) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments.  Nothing is read yet: pages with
+  // file contents are read by execfault, and the rest (BSS) is
+  // filled with zeros by lazy_handler, when first touched.
   sz = 0;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
@@ -47,15 +62,22 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
-      goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz > MMAPBASE)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.off + ph.filesz < ph.off)
       goto bad;
+    if(ph.filesz > 0){
+      if(img.nseg >= NEXECSEG)
+        goto bad;
+      img.seg[img.nseg].va = ph.vaddr;
+      img.seg[img.nseg].filesz = ph.filesz;
+      img.seg[img.nseg].off = ph.off;
+      img.nseg++;
+    }
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
+  img.ip = iexecdup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -91,16 +113,13 @@ exec(char *path, char **argv)
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  safestrcpy(name, last, namesz);
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
-  curproc->tf->esp = sp;
-  switchuvm(curproc);
-  freevm(oldpgdir);
+  *pgdirp = pgdir;
+  *szp = sz;
+  *entryp = elf.entry;
+  *spp = sp;
+  *exe = img;
   return 0;
 
  bad:
@@ -110,5 +129,126 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(img.ip){
+    begin_op();
+    iexecput(img.ip);
+    end_op();
+  }
   return -1;
 }
+
+// The segment of p's program whose file contents cover va, or 0.
+static struct execseg*
+findseg(struct proc *p, uint va)
+{
+  struct execseg *s;
+
+  for(s = p->exe.seg; s < &p->exe.seg[p->exe.nseg]; s++)
+    if(s->va <= va && va < s->va + s->filesz)
+      return s;
+  return 0;
+}
+
+// Does the page at va in p come from p's program file?
+int
+execpage(struct proc *p, uint va)
+{
+  return findseg(p, va) != 0;
+}
+
+// Page fault at va (page aligned) below sz in the current process.
+// If va is in the part of a program segment that comes from the
+// file, read the page in.  A page that is only read is shared with
+// other processes running the program through the page cache
+// (pcache.c) and mapped read-only, so a later write copies it in
+// CoW_handler.  Returns 0 if handled, -1 on error, or 1 if va has
+// no file contents.
+int
+execfault(uint va, int write)
+{
+  struct proc *p = myproc();
+  struct execseg *s;
+  char *mem;
+  uint off, n;
+
+  if((s = findseg(p, va)) == 0)
+    return 1;
+  off = s->off + (va - s->va);
+  n = s->va + s->filesz - va;
+  if(n > PGSIZE)
+    n = PGSIZE;
+
+  if(!write){
+    if((mem = pcacheget(p->exe.ip, off, n)) == 0)
+      return -1;
+    if(mapuvm(p->pgdir, va, mem, PTE_U) < 0){
+      kfree(mem);
+      return -1;
+    }
+    countfault(VM_FAULT_FILE);
+    return 0;
+  }
+
+  // 처음부터 write면 공유할 일이 없으니 바로 자기 page로 읽는다
+  if((mem = kallocwait(0)) == 0)
+    return -1;
+  ilock(p->exe.ip);
+  if(readi(p->exe.ip, mem, off, n) != n){
+    iunlock(p->exe.ip);
+    kfree(mem);
+    return -1;
+  }
+  iunlock(p->exe.ip);
+  memset(mem + n, 0, PGSIZE - n);
+  if(mapuvm(p->pgdir, va, mem, PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  countfault(VM_FAULT_FILE);
+  return 0;
+}
+
+int
+exec(char *path, char **argv)
+{
+  uint sz, oldsz, entry, sp;
+  pde_t *pgdir, *oldpgdir;
+  struct memcount oldmem;
+  char name[sizeof(myproc()->name)];
+  struct execimg exe, oldexe;
+  struct proc *curproc = myproc();
+
+  if(loaduser(path, argv, &pgdir, &sz, &entry, &sp, name, sizeof(name),
+              &exe) < 0)
+    return -1;
+  safestrcpy(curproc->name, name, sizeof(curproc->name));
+
+  // mmap regions do not survive exec.
+  vmafreeall(curproc);
+
+  // Commit to the user image.
+  oldpgdir = curproc->pgdir;
+  oldsz = curproc->sz;
+  oldmem = curproc->mem;
+  oldexe = curproc->exe;
+  curproc->pgdir = pgdir;
+  curproc->sz = sz;
+  curproc->exe = exe;
+  memrecount(curproc);
+  curproc->tf->eip = entry;  // main
+  curproc->tf->esp = sp;
+  switchuvm(curproc);
+
+  // A vfork child hands the address space back to its parent
+  // instead of freeing it.
+  if(curproc->vforked)
+    vforkdone(curproc, oldsz, &oldmem);
+  else
+    freevm(oldpgdir);
+  if(oldexe.ip){
+    begin_op();
+    iexecput(oldexe.ip);
+    end_op();
+  }
+  return 0;
+}
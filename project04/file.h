@@ -14,6 +14,9 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int nexec;          // of those, processes running it (under icache.lock)
+  struct inode *next; // icache list
+  struct cpage *pages; // cached pages (pcache.c), under pcache.lock
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -17,6 +17,7 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
@@ -155,9 +156,16 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// entries. In-memory inodes come from a slab cache and stay on
+// icache.list after the last iput, most recently used first, so that
+// the next lookup of the same file (and its cached program pages,
+// see pcache.c) need not go to the disk.  Up to NIUNUSED such unused
+// inodes are kept; beyond that, or when kswapd asks (icacheshrink),
+// the least recently used are freed.  An inode that was never read
+// or was freed on disk is freed at once.
+// Since ip->dev and ip->inum indicate which i-node an entry
+// holds, one must hold icache.lock while using any of those fields
+// or ip->ref.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
@@ -165,19 +173,22 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *list;
+  struct kmem_cache cache;
+  int nunused;          // entries on list with ref == 0
 } icache;
 
+// Called from main, before the first iget (userinit's namei).
 void
-iinit(int dev)
+icacheinit(void)
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  kmem_cache_init(&icache.cache, "inode", sizeof(struct inode));
+}
 
+void
+iinit(int dev)
+{
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
@@ -241,31 +252,34 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = icache.list; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref == 0)
+        icache.nunused--;
       ip->ref++;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Allocate an inode cache entry.
+  if((ip = kmem_cache_alloc(&icache.cache)) == 0)
     panic("iget: no inodes");
 
-  ip = empty;
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
+  ip->nexec = 0;
   ip->valid = 0;
+  ip->pages = 0;
+  ip->next = icache.list;
+  icache.list = ip;
   release(&icache.lock);
 
   return ip;
@@ -282,6 +296,29 @@ idup(struct inode *ip)
   return ip;
 }
 
+// A process starts running the program in ip: take a reference that
+// also keeps the file from being written (see writei).  Returns ip.
+struct inode*
+iexecdup(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->ref++;
+  ip->nexec++;
+  release(&icache.lock);
+  return ip;
+}
+
+// Drop a reference taken by iexecdup.  Like iput, call inside a
+// transaction.
+void
+iexecput(struct inode *ip)
+{
+  acquire(&icache.lock);
+  ip->nexec--;
+  release(&icache.lock);
+  iput(ip);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
@@ -321,6 +358,41 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Free up to n unused inodes, least recently used first.
+// Caller holds icache.lock.
+static int
+ievict(int n)
+{
+  struct inode *ip, **pp, **last;
+  int nfreed;
+
+  for(nfreed = 0; nfreed < n && icache.nunused > 0; nfreed++){
+    last = 0;
+    for(pp = &icache.list; *pp; pp = &(*pp)->next)
+      if((*pp)->ref == 0)
+        last = pp;
+    ip = *last;
+    *last = ip->next;
+    icache.nunused--;
+    pcacheinval(ip);
+    kmem_cache_free(&icache.cache, ip);
+  }
+  return nfreed;
+}
+
+// Free up to n unused inodes and their cached program pages.
+// Used by kswapd.  Returns the number freed.
+int
+icacheshrink(int n)
+{
+  int nfreed;
+
+  acquire(&icache.lock);
+  nfreed = ievict(n);
+  release(&icache.lock);
+  return nfreed;
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
 // be recycled.
@@ -331,6 +403,8 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct inode **pp;
+
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
     acquire(&icache.lock);
@@ -347,7 +421,21 @@ iput(struct inode *ip)
   releasesleep(&ip->lock);
 
   acquire(&icache.lock);
-  ip->ref--;
+  if(--ip->ref == 0){
+    for(pp = &icache.list; *pp != ip; pp = &(*pp)->next)
+      ;
+    *pp = ip->next;
+    if(ip->valid){
+      // 다음 iget이 다시 쓸 수 있도록 list 맨 앞에 남겨 둔다
+      ip->next = icache.list;
+      icache.list = ip;
+      if(++icache.nunused > NIUNUSED)
+        ievict(1);
+    } else {
+      pcacheinval(ip);
+      kmem_cache_free(&icache.cache, ip);
+    }
+  }
   release(&icache.lock);
 }
 
@@ -482,6 +570,7 @@ int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
   uint tot, m;
+  int busy;
   struct buf *bp;
 
   if(ip->type == T_DEV){
@@ -494,6 +583,17 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  // 실행 중인 program 파일은 고칠 수 없다 (ETXTBSY).  이미 mapping된
+  // page는 옛 내용, 나중에 읽는 page는 새 내용이 되어 섞이기 때문이다.
+  acquire(&icache.lock);
+  busy = ip->nexec > 0;
+  release(&icache.lock);
+  if(busy)
+    return -1;
+  // 실행 중인 program의 cache된 page는 더 이상 파일과 같지 않다.
+  // (page는 ip가 lock된 채로만 cache에 들어가므로 lock 없이 봐도 된다)
+  if(ip->pages)
+    pcacheinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= (b->dev == SWAPDEV ? SWAPSTART + NSWAPPAGE*(PGSIZE/BSIZE) : FSSIZE))
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -1,6 +1,7 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and physically
+// contiguous blocks of 2^order pages with kalloc_pages.
 
 #include "types.h"
 #include "defs.h"
@@ -8,44 +9,195 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "x86.h"
+#include "proc.h"
+#include "vmstat.h"
 
-#define PAGE_COUNT (PHYSTOP / PGSIZE) // 페이지 수
 #define PAGE_INDEX(pa) ((pa) / PGSIZE)// 페이지 인덱스를 계산하는 매크로
 
+#define KCACHE_BATCH 32   // pages moved between a CPU cache and kmem at once
+#define KCACHE_MAX   64   // a CPU cache holding more than this drains a batch
+#define KZERO_MAX    64   // pre-zeroed pages idle CPUs keep ready
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+// The BIOS memory map that bootasm.S leaves at E820MAP: a count,
+// then the entries.  Only the low 32 bits of addresses matter, since
+// the kernel cannot map memory above PHYSMAX anyway.
+struct e820 {
+  uint addr, addrhi;
+  uint len, lenhi;
+  uint type;
+};
+
+#define E820_RAM  1    // usable memory
+
+uint phystop;          // end of the physical memory the kernel uses
+
 struct run {
   struct run *next;
+  struct run *prev;   // buddy lists only
 };
 
+// Global pool of free pages, kept by a binary buddy allocator:
+// free[k] lists free blocks of 2^k pages, aligned to their size.
+// Freeing a block merges it with its buddy (the other half of the
+// next larger block) whenever that is free too, so large blocks
+// come back as memory is released.  kmem.lock protects everything
+// but use_lock.
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
-  int ref_cnt[PAGE_COUNT];
+  struct run *free[MAXORDER+1];
+  int nfree[MAXORDER+1];
   int num_freePage;
 } kmem;
 
+// Per-CPU cache of free single pages, so that most kalloc/kfree
+// calls touch no shared lock.  Only the owning CPU uses its cache,
+// with interrupts off; pages move to and from kmem in batches.
+struct {
+  struct run *freelist;
+  int nfree;
+} kcache[NCPU];
+
+// Virtual memory event counters (vmstat.h), one set per CPU so that
+// counting an event needs no lock.  vmstatsum adds them up.
+uint vmstats[NCPU][NVMSTAT];
+
+// Free pages that are already filled with zeros, for kzalloc.
+// Idle CPUs top the pool up from the scheduler loop (kzerofill), so
+// zeroing a page is usually off the fault, sbrk and exec paths.
+// The pages count as free memory and kalloc falls back on them.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+} kzero;
+
+// Per-page metadata, indexed by physical page number.
+// ref counts the page tables (and kernel users) that hold the page;
+// it is only changed with lock-prefixed instructions, so fork and
+// CoW faults take no lock to share or release a page.
+// flags and order are the buddy allocator's, under kmem.lock: the
+// first page of each free block in kmem has PG_BUDDY set and its
+// order recorded.  A block allocated with kalloc_pages keeps its
+// reference count in its first page.
+struct page {
+  volatile ushort ref;
+  uchar flags;
+  uchar order;
+};
+
+#define PG_BUDDY  0x1   // first page of a free block in kmem.free
+
+// One per page below phystop, allocated by kinit1 right after the
+// kernel.
+struct page *pages;
+
+// 한 번도 write하지 않은 익명 메모리(lazy heap, BSS)에 read only로
+// 공유해서 mapping하는 0으로 채워진 page.
+// free되지 않으며, 참조값도 관리하지 않는다.
+char *zeropage;
+
+// Usable memory [*start, *end) of entry i of the BIOS map, cut off
+// at PHYSMAX.  Returns 0 if the entry is not usable memory there.
+static int
+e820ram(int i, uint *start, uint *end)
+{
+  struct e820 *e = &((struct e820*)P2V(E820MAP + 4))[i];
+
+  if(e->type != E820_RAM || e->addrhi != 0 || e->addr >= PHYSMAX)
+    return 0;
+  *start = PGROUNDUP(e->addr);
+  if(e->lenhi != 0 || e->len > PHYSMAX - e->addr)
+    *end = PHYSMAX;
+  else
+    *end = PGROUNDDOWN(e->addr + e->len);
+  return *start < *end;
+}
+
+// Number of entries in the BIOS map.
+static int
+e820count(void)
+{
+  uint n = *(uint*)P2V(E820MAP);
+
+  return n < NE820 ? n : NE820;
+}
+
+// Set phystop from the BIOS map: the end of the highest usable
+// memory, rounded down to a whole 4MB so that buddy blocks never
+// reach past it.  Without a map, assume PHYSTOP.
+static void
+findphystop(void)
+{
+  uint start, end;
+  int i;
+
+  phystop = 0;
+  for(i = 0; i < e820count(); i++)
+    if(e820ram(i, &start, &end) && end > phystop)
+      phystop = end;
+  if(phystop == 0)
+    phystop = PHYSTOP;
+  phystop &= ~(HUGEPGSIZE - 1);
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// kinit1 also sizes memory from the BIOS map and puts the per-page
+// metadata at vstart, so it must fit below vend.
 void
 kinit1(void *vstart, void *vend)
 {
+  uint n;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
   kmem.use_lock = 0;
-  freerange(vstart, vend);
+
+  findphystop();
+  n = phystop / PGSIZE * sizeof(struct page);
+  pages = (struct page*)PGROUNDUP((uint)vstart);
+  if(V2P(vend) > phystop)
+    panic("kinit1: too little memory");
+  if((char*)pages + n > (char*)vend)
+    panic("kinit1: too much memory");
+  memset(pages, 0, n);
+  freerange((char*)pages + n, vend);
+
+  if((zeropage = kalloc()) == 0)
+    panic("kinit1: zeropage");
+  memset(zeropage, 0, PGSIZE);
 }
 
+// Free the usable memory in [vstart, vend): the parts the BIOS map
+// says are memory, or all of it if there is no map.
 void
 kinit2(void *vstart, void *vend)
 {
-  freerange(vstart, vend);
+  uint start, end;
+  int i;
+
+  if(e820count() == 0)
+    freerange(vstart, vend);
+  for(i = 0; i < e820count(); i++){
+    if(!e820ram(i, &start, &end))
+      continue;
+    // 두 범위가 겹치는 부분만
+    if(start < V2P(vstart))
+      start = V2P(vstart);
+    if(end > V2P(vend))
+      end = V2P(vend);
+    if(start < end)
+      freerange(P2V(start), P2V(end));
+  }
   kmem.use_lock = 1;
 }
 
@@ -55,11 +207,119 @@ freerange(void *vstart, void *vend)
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
-    kmem.ref_cnt[V2P(p)/PGSIZE] = 0;
+    // kfree가 1 -> 0으로 줄이면서 free list에 넣는다
+    pages[PAGE_INDEX(V2P(p))].ref = 1;
     kfree(p);
   }
     
 }
+//PAGEBREAK!
+// Buddy allocator.  Caller must hold kmem.lock (or be running
+// before kinit2, when there is only one CPU).
+
+static void
+buddyinsert(struct run *r, int order)
+{
+  struct page *pg = &pages[PAGE_INDEX(V2P((char*)r))];
+
+  pg->flags |= PG_BUDDY;
+  pg->order = order;
+  r->prev = 0;
+  r->next = kmem.free[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[order] = r;
+  kmem.nfree[order]++;
+}
+
+static void
+buddyremove(struct run *r, int order)
+{
+  pages[PAGE_INDEX(V2P((char*)r))].flags &= ~PG_BUDDY;
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nfree[order]--;
+}
+
+// Take a block of 2^order pages, splitting a larger one if needed.
+static struct run*
+buddyalloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k <= MAXORDER && kmem.free[k] == 0; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.free[k];
+  buddyremove(r, k);
+  // 남는 위쪽 절반들은 한 단계씩 작은 list로 돌려준다
+  while(k > order){
+    k--;
+    buddyinsert((struct run*)((char*)r + (PGSIZE << k)), k);
+  }
+  kmem.num_freePage -= 1 << order;
+  return r;
+}
+
+// Give back a block of 2^order pages, merging it with its buddy
+// for as long as the buddy is a free block of the same order.
+static void
+buddyfree(char *v, int order)
+{
+  uint pn, bn;
+
+  kmem.num_freePage += 1 << order;
+  pn = PAGE_INDEX(V2P(v));
+  while(order < MAXORDER){
+    // phystop은 4MB의 배수이므로 bn은 항상 pages 안에 있다
+    bn = pn ^ (1 << order);
+    if(!(pages[bn].flags & PG_BUDDY) || pages[bn].order != order)
+      break;
+    buddyremove((struct run*)P2V(bn * PGSIZE), order);
+    pn &= ~(1 << order);
+    order++;
+  }
+  buddyinsert((struct run*)P2V(pn * PGSIZE), order);
+}
+
+// Move up to n pages from kmem to the cache of CPU id.
+// Caller must have interrupts off.
+static void
+krefill(int id, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = buddyalloc(0)) != 0){
+    r->next = kcache[id].freelist;
+    kcache[id].freelist = r;
+    kcache[id].nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Move up to n pages from the cache of CPU id back to kmem.
+// Caller must have interrupts off.
+static void
+kdrain(int id, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = kcache[id].freelist) != 0){
+    kcache[id].freelist = r->next;
+    kcache[id].nfree--;
+    buddyfree((char*)r, 0);
+  }
+  release(&kmem.lock);
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -68,33 +328,66 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
-
-  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+  if((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
     panic("kfree");
 
-  // Fill with junk to catch dangling refs.
-  // -> 여기서 지우지 않고 그냥 다 free 해서 오류 발생
-  //memset(v, 1, PGSIZE);
+  // zero page는 mapping이 없어져도 free하지 않는다
+  if(v == zeropage)
+    return;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
+  // 참조값을 줄이고, 마지막 참조였을 경우에만 메모리 free
+  if(!put_page(V2P(v)))
+    return;
+  freepage(v);
+}
+
+// Put page v on the free list.  Its reference count must
+// already be 0: either kfree dropped it, or the caller got 1
+// from put_page and has finished tearing the page down.
+void
+freepage(char *v)
+{
+  struct run *r;
+  int id;
+
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE);
   r = (struct run*)v;
 
-  //cnt_ref 줄이기
-  if(kmem.ref_cnt[V2P(v)/PGSIZE] > 0) 
-    kmem.ref_cnt[V2P(v)/PGSIZE] = kmem.ref_cnt[V2P(v)/PGSIZE] - 1;
+  // Before kinit2 there is only one CPU and no cpu id yet.
+  if(!kmem.use_lock){
+    buddyfree(v, 0);
+    return;
+  }
+
+  pushcli();
+  id = cpuid();
+  vmstats[id][VM_KFREE]++;
+  r->next = kcache[id].freelist;
+  kcache[id].freelist = r;
+  kcache[id].nfree++;
+  if(kcache[id].nfree > KCACHE_MAX)
+    kdrain(id, KCACHE_BATCH);
+  popcli();
+}
 
-  //ref_cnt==0 일 경우에만 메모리 free
-  if(kmem.ref_cnt[V2P(v)/PGSIZE] == 0){   
-    
-    memset(v, 1, PGSIZE); 
-    r->next = kmem.freelist;
-    kmem.num_freePage = kmem.num_freePage + 1;
-    kmem.freelist = r;
+// Take a page from the pre-zeroed pool, or return 0 if it is empty.
+// Word 0 held the free list link and is cleared again here.
+static struct run*
+kzeropop(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.nfree--;
   }
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  release(&kzero.lock);
+  if(r)
+    r->next = 0;
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -104,73 +397,237 @@ char*
 kalloc(void)
 {
   struct run *r;
+  int id;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r){
-    kmem.freelist = r->next;
-    // 처음 할당하는 순간 ref_cnt = 1
-    kmem.ref_cnt[V2P((char*)r)/PGSIZE] = 1;
-    // free page --
-    kmem.num_freePage--;
+  if(!kmem.use_lock){
+    r = buddyalloc(0);
+  } else {
+    pushcli();
+    id = cpuid();
+    if(kcache[id].freelist == 0)
+      krefill(id, KCACHE_BATCH);
+    r = kcache[id].freelist;
+    if(r){
+      kcache[id].freelist = r->next;
+      kcache[id].nfree--;
+      // kzero의 page는 kzerofill이 가져갈 때 이미 세었다
+      vmstats[id][VM_KALLOC]++;
     }
+    popcli();
+    if(r == 0 && (r = kzeropop()) == 0)
+      vmcount(VM_KALLOC_FAIL);
+  }
 
-  if(kmem.use_lock){
-    release(&kmem.lock);
+  // 처음 할당하는 순간 ref = 1
+  // (free page는 아무도 참조하지 않으므로 그냥 store 해도 된다)
+  if(r)
+    pages[PAGE_INDEX(V2P((char*)r))].ref = 1;
+  return (char*)r;
+}
+
+// Allocate one page filled with zeros.
+// Returns 0 if the memory cannot be allocated.
+char*
+kzalloc(void)
+{
+  struct run *r;
+  char *mem;
+
+  if(kmem.use_lock && (r = kzeropop()) != 0){
+    pages[PAGE_INDEX(V2P((char*)r))].ref = 1;
+    return (char*)r;
   }
+  if((mem = kalloc()) != 0)
+    memset(mem, 0, PGSIZE);
+  return mem;
+}
+
+// Called by the scheduler when it found nothing to run: zero one
+// free page and add it to the pre-zeroed pool, unless the pool is
+// full.  Runs with interrupts on and no locks held.
+void
+kzerofill(void)
+{
+  struct run *r;
+  char *mem;
+
+  // 다른 CPU는 kinit2 전에 scheduler에 들어온다
+  if(!kmem.use_lock || kzero.nfree >= KZERO_MAX)
+    return;
+  if((mem = kalloc()) == 0)
+    return;
+  memset(mem, 0, PGSIZE);
+  pages[PAGE_INDEX(V2P(mem))].ref = 0;
+
+  r = (struct run*)mem;
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.nfree++;
+  release(&kzero.lock);
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their
+// size.  Returns a pointer that the kernel can use, or 0.
+// Single pages should come from kalloc, which has a per-CPU cache.
+char*
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order > MAXORDER)
+    panic("kalloc_pages");
+  if(order == 0)
+    return kalloc();
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = buddyalloc(order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
+  if(r)
+    pages[PAGE_INDEX(V2P((char*)r))].ref = 1;
   return (char*)r;
 }
 
-// 메모리 참조값 증가
-void 
-incr_refc(uint pa)
+// Free a block from kalloc_pages(order).  Unlike kfree this does not
+// look at the reference count: the caller owns the block (or has
+// dropped the last reference with put_page).
+void
+kfree_pages(char *v, int order)
 {
-  acquire(&kmem.lock);
+  if(order < 0 || order > MAXORDER ||
+     (uint)v % (PGSIZE << order) || v < end || V2P(v) >= phystop)
+    panic("kfree_pages");
+  pages[PAGE_INDEX(V2P(v))].ref = 0;
+  if(order == 0){
+    freepage(v);
+    return;
+  }
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  buddyfree(v, order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
 
-  int index = PAGE_INDEX(pa);
-  kmem.ref_cnt[index]++;
+// A 4MB page for hsbrk is just the largest buddy block.
+// The memory is not cleared.
+char*
+hugealloc(void)
+{
+  return kalloc_pages(MAXORDER);
+}
+
+// The caller must already have dropped the last reference.
+void
+hugefree(char *v)
+{
+  kfree_pages(v, MAXORDER);
+}
+
+// Copy the number of free blocks of each order (MAXORDER+1 of them)
+// to nfree.  Pages in the per-CPU caches and the zeroed pool are
+// not included.  Returns the largest order with a free block, or -1.
+// Free memory spread over many small blocks means fragmentation.
+int
+buddyinfo(int *nfree)
+{
+  int k, max;
 
+  max = -1;
+  acquire(&kmem.lock);
+  for(k = 0; k <= MAXORDER; k++){
+    nfree[k] = kmem.nfree[k];
+    if(nfree[k])
+      max = k;
+  }
   release(&kmem.lock);
+  return max;
+}
 
+// 메모리 참조값 증가
+void 
+incr_refc(uint pa)
+{
+  // 16bit 참조값이 넘치면 page가 아직 mapping된 채 free된다
+  if(xaddw(&pages[PAGE_INDEX(pa)].ref, 1) == 0xffff)
+    panic("incr_refc");
 }
 
 // 메모리 참조값 감소
+// (page를 free하지 않는다; 마지막 참조를 놓을 때는 kfree를 쓸 것)
 void 
 decr_refc(uint pa)
 {
-  acquire(&kmem.lock);
-  int index = PAGE_INDEX(pa);
-  kmem.ref_cnt[index]--;
-  
-  release(&kmem.lock);
+  xaddw(&pages[PAGE_INDEX(pa)].ref, -1);
+}
+
+// 메모리 참조값을 줄이고, 마지막 참조였으면 1을 return
+// (그 경우 caller가 page를 free해야 한다)
+int
+put_page(uint pa)
+{
+  ushort old;
+
+  old = xaddw(&pages[PAGE_INDEX(pa)].ref, -1);
+  if(old == 0)
+    panic("put_page");
+  return old == 1;
 }
 
 // 메모리 참조 갯수 return
 int 
 get_refc(uint pa)
 {
-  int count;
-
-  acquire(&kmem.lock);
-
-  int index = PAGE_INDEX(pa);
-  count = kmem.ref_cnt[index];
-  
-  release(&kmem.lock);
-
-  return count;
-
+  return pages[PAGE_INDEX(pa)].ref;
 } 
 
 // free page 갯수 반환
+// (전역 pool + 각 CPU cache + 0으로 채워둔 pool에 있는 page)
 int 
 countfp(void)
 {
+  int i;
+
   acquire(&kmem.lock);
 
   uint num_freePage = kmem.num_freePage;
+  for(i = 0; i < ncpu; i++)
+    num_freePage += kcache[i].nfree;
   release(&kmem.lock);
+  num_freePage += kzero.nfree;
   
   return num_freePage;
 }
+
+// Count n events of kind i (VM_* in vmstat.h) on this CPU.
+void
+vmadd(int i, uint n)
+{
+  pushcli();
+  vmstats[cpuid()][i] += n;
+  popcli();
+}
+
+void
+vmcount(int i)
+{
+  vmadd(i, 1);
+}
+
+// Add up the event counters of all CPUs into st.  The sum is not a
+// snapshot: other CPUs keep counting while it is taken.
+void
+vmstatsum(struct vmstat *st)
+{
+  int i, c;
+
+  for(i = 0; i < NVMSTAT; i++){
+    st->n[i] = 0;
+    for(c = 0; c < ncpu; c++)
+      st->n[i] += vmstats[c][i];
+  }
+}
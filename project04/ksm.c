@@ -0,0 +1,260 @@
+// Same-page merging.
+//
+// When turned on with the ksm system call, the ksmd kernel thread
+// goes round the heap and stack pages of idle processes (ksmprocs in
+// proc.c) a few at a time, looking for pages with the same contents.
+// Two such pages are merged into one, mapped read-only everywhere
+// with a reference count per mapping, and the other is freed.  A
+// later write to the merged page gets its own copy in CoW_handler,
+// as for any page shared by fork.  A page full of zeros is replaced
+// by the zero page.
+//
+// Pages are found by a hash of their contents and always compared in
+// full before merging.  Merged pages are kept in the stable table,
+// which holds a reference to each so that it stays in place; pages
+// seen once are remembered in the unstable table by process and
+// address only, because their contents may still change.  A page
+// written to since the last pass (PTE_D) is skipped for one pass, so
+// pages that change all the time are not hashed over and over.
+//
+// Like swapscan, only pages with a reference count of 1 in page
+// tables that are not shared are taken; 4MB pages, mmap regions and
+// program pages (execpage) are left alone.  Processes in a page fault
+// or system call are skipped too (procidle): their handler may have
+// the PTE or page that merge would replace in hand.  Everything runs
+// in ksmd, holding ptable.lock, so the tables need no lock of their
+// own.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "vmstat.h"
+
+#define KSMTICKS  10   // ticks between passes
+#define KSMBATCH  64   // pages looked at per pass
+#define KSMMAXREF 0xff00  // most mappings of one merged page (refc is 16 bits)
+
+struct {
+  int on;
+  int merged;                   // pages merged since boot
+  struct {
+    uint hash;
+    char *page;                 // 0 if free
+  } stable[NKSM];
+  struct {
+    uint hash;
+    struct proc *p;             // 0 if free
+    int pid;
+    uint va;
+  } unstable[NKSM];
+} ksm;
+
+static void ksmd(void);
+
+void
+ksminit(void)
+{
+  kthread("ksmd", ksmd);
+}
+
+// Turn merging on or off.  Returns the number of pages merged so far.
+int
+ksmctl(int on)
+{
+  ksm.on = on;
+  return ksm.merged;
+}
+
+static uint
+pagehash(char *page)
+{
+  uint *w, h;
+
+  h = 0;
+  for(w = (uint*)page; w < (uint*)(page + PGSIZE); w++)
+    h = h * 31 + *w;
+  return h;
+}
+
+static int
+zeroed(char *page)
+{
+  uint *w;
+
+  for(w = (uint*)page; w < (uint*)(page + PGSIZE); w++)
+    if(*w)
+      return 0;
+  return 1;
+}
+
+// The PTE of a page of p at va that may be merged, or 0.
+static pte_t*
+mergeable(struct proc *p, uint va)
+{
+  pde_t *pde;
+  pte_t *pte;
+  uint pa;
+
+  pde = &p->pgdir[PDX(va)];
+  if(!(*pde & PTE_P) || (*pde & PTE_PS) || !(*pde & PTE_W))
+    return 0;
+  pte = &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(va)];
+  if(!(*pte & PTE_P) || !(*pte & PTE_U))
+    return 0;
+  pa = PTE_ADDR(*pte);
+  if(pa == V2P(zeropage) || get_refc(pa) != 1)
+    return 0;
+  // program page는 execfault가 page cache와 공유한다
+  if(execpage(p, va))
+    return 0;
+  return pte;
+}
+
+// Map page (already holding the reference for it) read-only at pte
+// of p instead of the page there, which is freed.
+static void
+replace(struct proc *p, pte_t *pte, char *page)
+{
+  char *old;
+
+  old = P2V(PTE_ADDR(*pte));
+  if(*pte & PTE_W)
+    p->mem.cow++;
+  *pte = V2P(page) | PTE_P | PTE_U | (*pte & PTE_A);
+  kfree(old);
+  ksm.merged++;
+  vmcount(VM_KSM_MERGE);
+}
+
+// Drop merged pages that nobody maps any more.
+static void
+prune(void)
+{
+  int i;
+
+  for(i = 0; i < NKSM; i++){
+    if(ksm.stable[i].page && get_refc(V2P(ksm.stable[i].page)) == 1){
+      kfree(ksm.stable[i].page);
+      ksm.stable[i].page = 0;
+    }
+  }
+}
+
+// Try to merge the page of p at va, mapped by pte.
+static void
+merge(struct proc *p, uint va, pte_t *pte)
+{
+  char *page, *other;
+  pte_t *opte;
+  uint h;
+  int i;
+
+  page = P2V(PTE_ADDR(*pte));
+  if(zeroed(page)){
+    replace(p, pte, zeropage);
+    return;
+  }
+  h = pagehash(page);
+  i = h % NKSM;
+
+  // 이미 합쳐진 page 중에 같은 것이 있으면 그쪽을 쓴다
+  other = ksm.stable[i].page;
+  if(other && ksm.stable[i].hash == h && memcmp(page, other, PGSIZE) == 0){
+    if(get_refc(V2P(other)) < KSMMAXREF){
+      incr_refc(V2P(other));
+      replace(p, pte, other);
+      return;
+    }
+    // 참조값이 한계에 가까우면 이 page는 table에서 빼고 (mapping은
+    // 그대로 둔다), 다음에 같은 내용의 page가 새 stable page가 된다
+    kfree(other);
+    ksm.stable[i].page = 0;
+    other = 0;
+  }
+
+  // 전에 본 page와 같으면 그 page를 stable로 올리고 합친다.
+  // 그 page는 그 사이 바뀌었거나 없어졌을 수 있으니 다시 확인한다.
+  if(ksm.unstable[i].p && ksm.unstable[i].hash == h && other == 0 &&
+     ksm.unstable[i].p->pid == ksm.unstable[i].pid &&
+     procidle(ksm.unstable[i].p) &&
+     (opte = mergeable(ksm.unstable[i].p, ksm.unstable[i].va)) != 0 &&
+     opte != pte){
+    other = P2V(PTE_ADDR(*opte));
+    if(memcmp(page, other, PGSIZE) == 0){
+      if(*opte & PTE_W){
+        *opte &= ~PTE_W;
+        ksm.unstable[i].p->mem.cow++;
+      }
+      incr_refc(V2P(other));   // stable table의 참조
+      ksm.stable[i].hash = h;
+      ksm.stable[i].page = other;
+      ksm.unstable[i].p = 0;
+      incr_refc(V2P(other));
+      replace(p, pte, other);
+      return;
+    }
+  }
+
+  ksm.unstable[i].hash = h;
+  ksm.unstable[i].p = p;
+  ksm.unstable[i].pid = p->pid;
+  ksm.unstable[i].va = va;
+}
+
+// Look at p's pages from *hand up to p->sz, at most n of them, and
+// merge those that can be.  Leaves *hand where it stopped and returns
+// the number of pages looked at.  Called by ksmprocs with ptable.lock
+// held and p idle, so no TLB holds p's entries.
+int
+ksmscan(struct proc *p, uint *hand, int n)
+{
+  pde_t *pde;
+  pte_t *pte;
+  uint a;
+  int i;
+
+  i = 0;
+  for(a = PGROUNDDOWN(*hand); a < p->sz && i < n; a += PGSIZE){
+    pde = &p->pgdir[PDX(a)];
+    if(!(*pde & PTE_P) || (*pde & PTE_PS) || !(*pde & PTE_W)){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    if((pte = mergeable(p, a)) == 0)
+      continue;
+    i++;
+    // 최근에 쓴 page는 이번에는 건너뛴다
+    if(*pte & PTE_D){
+      *pte &= ~PTE_D;
+      continue;
+    }
+    merge(p, a, pte);
+  }
+  *hand = a;
+  return i;
+}
+
+// Kernel thread: every KSMTICKS ticks, while merging is on, look at
+// the next KSMBATCH pages.
+static void
+ksmd(void)
+{
+  int t;
+
+  for(;;){
+    for(t = 0; t < KSMTICKS; t++){
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+    }
+    if(!ksm.on)
+      continue;
+    prune();
+    ksmprocs(KSMBATCH);
+  }
+}
@@ -30,10 +30,16 @@ main(void)
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  icacheinit();    // inode cache
+  pipeinit();      // pipe cache
+  pcacheinit();    // program page cache
+  mmapinit();      // pages of shared mmap regions
   ideinit();       // disk 
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  kinit2(P2V(4*1024*1024), P2V(phystop)); // must come after startothers()
   userinit();      // first user process
+  swapinit();      // swap space and kswapd
+  ksminit();       // same-page merging thread
   mpmain();        // finish this processor's setup
 }
 
@@ -1,12 +1,16 @@
 // Memory layout
 
 #define EXTMEM  0x100000            // Start of extended memory
-#define PHYSTOP 0xE000000           // Top physical memory
+#define PHYSTOP 0xE000000           // Top physical memory if the BIOS has no map
+#define PHYSMAX (DEVSPACE-KERNBASE) // Most physical memory the kernel can map
 #define DEVSPACE 0xFE000000         // Other devices are at high addresses
+#define E820MAP 0x6000              // bootasm.S leaves the BIOS memory map here
+#define NE820   64                  // most entries it leaves there
 
 // Key addresses for address space layout (see kmap in vm.c for layout)
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
+#define MMAPBASE 0x40000000         // mmap regions: MMAPBASE..KERNBASE
 
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
@@ -0,0 +1,9 @@
+// Memory use of the calling process, returned by memstat().
+// Counts are in pages; a 4MB page counts as 1024.
+struct memstat {
+  int vp;    // virtual pages: heap and stack below sz plus mmap regions
+  int rss;   // resident pages
+  int cow;   // resident pages mapped read-only, shared or copy-on-write
+  int ptp;   // page table pages, including the page directory
+  int fp;    // free physical pages in the whole system
+};
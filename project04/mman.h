@@ -0,0 +1,11 @@
+// mmap() protection and flags.
+#define PROT_READ     0x1   // every mapping is readable
+#define PROT_WRITE    0x2
+
+#define MAP_SHARED    0x01  // writes are seen by forked children and
+                            // written back to the file
+#define MAP_PRIVATE   0x02  // writes are copy-on-write
+#define MAP_FIXED     0x10  // map exactly at addr
+#define MAP_ANONYMOUS 0x20  // zero-filled memory, no file
+
+#define MAP_FAILED    ((void*)-1)
@@ -0,0 +1,515 @@
+// Memory-mapped regions (mmap/munmap).
+//
+// Each process has up to NVMA regions between MMAPBASE and KERNBASE,
+// above anything sbrk can reach.  mmap only records the region; its
+// pages are faulted in one at a time by mmapfault (from lazy_handler),
+// zero-filled for anonymous memory or read from the file with readi.
+//
+// A private region is copy-on-write on fork like the rest of user
+// memory.  A shared region maps the same pages, writable, in parent
+// and child.  fork only copies the pages the parent has mapped; the
+// rest are faulted in later by whichever process touches them first.
+// So that the others then find the same page, a shared region that
+// has been forked has a vmshare, which holds each of its pages by
+// offset (the file offset, or the offset into an anonymous region).
+// Dirty (PTE_D) pages of a shared writable file region are written
+// back to the file on munmap, exec and exit.  Regions are not shared
+// between processes that mapped the same file on their own.
+//
+// mmap'ed pages are never swapped out: swapscan only looks below sz.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "stat.h"
+#include "mman.h"
+#include "vmstat.h"
+#include "slab.h"
+
+// A page of a shared region, at offset off.
+struct shpage {
+  uint off;
+  char *page;                  // holds a reference of its own
+  struct shpage *next;
+};
+
+// The pages of a shared region, for all the processes that have it.
+// Pages stay until the last region goes, even if munmap cuts off
+// part of one.
+struct vmshare {
+  int ref;                     // regions pointing here
+  struct shpage *pages;
+};
+
+struct {
+  struct spinlock lock;        // protects every vmshare
+  struct kmem_cache sharecache;
+  struct kmem_cache pagecache;
+} shtab;
+
+static void vmaput(struct vma*);
+
+void
+mmapinit(void)
+{
+  initlock(&shtab.lock, "vmshare");
+  kmem_cache_init(&shtab.sharecache, "vmshare", sizeof(struct vmshare));
+  kmem_cache_init(&shtab.pagecache, "shpage", sizeof(struct shpage));
+}
+
+// Return sh's page at off with a reference for the caller, or 0.
+static char*
+shget(struct vmshare *sh, uint off)
+{
+  struct shpage *s;
+  char *mem;
+
+  mem = 0;
+  acquire(&shtab.lock);
+  for(s = sh->pages; s; s = s->next){
+    if(s->off == off){
+      mem = s->page;
+      incr_refc(V2P(mem));
+      break;
+    }
+  }
+  release(&shtab.lock);
+  return mem;
+}
+
+// Make mem (the caller holds a reference to it) sh's page at off,
+// unless another process got there first: then drop mem and return
+// that page instead, again with a reference for the caller.  Returns
+// 0 if out of memory.
+static char*
+shadd(struct vmshare *sh, uint off, char *mem)
+{
+  struct shpage *s;
+
+  acquire(&shtab.lock);
+  for(s = sh->pages; s; s = s->next){
+    if(s->off == off){
+      incr_refc(V2P(s->page));
+      release(&shtab.lock);
+      kfree(mem);
+      return s->page;
+    }
+  }
+  if((s = kmem_cache_alloc(&shtab.pagecache)) == 0){
+    release(&shtab.lock);
+    kfree(mem);
+    return 0;
+  }
+  s->off = off;
+  s->page = mem;
+  incr_refc(V2P(mem));
+  s->next = sh->pages;
+  sh->pages = s;
+  release(&shtab.lock);
+  return mem;
+}
+
+// Drop a region's reference to sh, freeing it with the last.
+static void
+shput(struct vmshare *sh)
+{
+  struct shpage *s;
+
+  acquire(&shtab.lock);
+  if(--sh->ref > 0){
+    release(&shtab.lock);
+    return;
+  }
+  release(&shtab.lock);
+  while((s = sh->pages) != 0){
+    sh->pages = s->next;
+    kfree(s->page);
+    kmem_cache_free(&shtab.pagecache, s);
+  }
+  kmem_cache_free(&shtab.sharecache, sh);
+}
+
+// Give shared region v of p a vmshare holding the pages p has
+// mapped so far, before fork lets another process share them.
+// Returns -1 if out of memory.
+static int
+shcreate(struct proc *p, struct vma *v)
+{
+  struct vmshare *sh;
+  char *mem;
+  uint a;
+
+  if((sh = kmem_cache_alloc(&shtab.sharecache)) == 0)
+    return -1;
+  sh->ref = 1;
+  sh->pages = 0;
+  for(a = v->start; (mem = nextpage(p->pgdir, &a, v->end)) != 0; a += PGSIZE){
+    incr_refc(V2P(mem));
+    if(shadd(sh, v->off + (a - v->start), mem) == 0){
+      shput(sh);
+      return -1;
+    }
+    kfree(mem);   // shadd이 돌려준 참조
+  }
+  v->sh = sh;
+  return 0;
+}
+
+// Return p's region containing va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end && v->start <= va && va < v->end)
+      return v;
+  return 0;
+}
+
+// Does [start, end) overlap any of p's regions?
+static int
+overlaps(struct proc *p, uint start, uint end)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end && v->start < end && start < v->end)
+      return 1;
+  return 0;
+}
+
+// First free range of len bytes above MMAPBASE, or 0.
+static uint
+findgap(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  a = MMAPBASE;
+again:
+  if(a + len > KERNBASE)
+    return 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end && v->start < a + len && a < v->end){
+      a = v->end;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Write the dirty pages of v in [start, end) back to its file, if v
+// is a shared writable file mapping.  The file never grows: the part
+// of the last page beyond the end of the file is dropped.
+static void
+vmaflush(struct proc *p, struct vma *v, uint start, uint end)
+{
+  struct inode *ip;
+  char *mem;
+  uint a, off, n;
+
+  if(v->f == 0 || !(v->flags & MAP_SHARED) || !(v->prot & PROT_WRITE))
+    return;
+  ip = v->f->ip;
+  for(a = start; (mem = nextdirty(p->pgdir, &a, end)) != 0; a += PGSIZE){
+    off = v->off + (a - v->start);
+    // page 하나(8 block)씩 transaction을 나눠야 log에 들어간다
+    begin_op();
+    ilock(ip);
+    if(off < ip->size){
+      n = ip->size - off;
+      if(n > PGSIZE)
+        n = PGSIZE;
+      writei(ip, mem, off, n);
+    }
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Map the page of v at va into p's address space.
+static int
+vmafill(struct proc *p, struct vma *v, uint va, int write)
+{
+  char *mem;
+  uint off;
+  int n, perm;
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+
+  // private anonymous page에 read만 하면 zero page를 read only로
+  // 준다. write하면 CoW_handler가 새 page를 할당한다.
+  if(v->f == 0 && !(v->flags & MAP_SHARED) && !write)
+    return mapuvm(p->pgdir, va, zeropage, PTE_U);
+
+  // fork로 공유된 region이면 다른 process가 먼저 가져온 page를 쓴다
+  off = v->off + (va - v->start);
+  if(v->sh && (mem = shget(v->sh, off)) != 0)
+    goto map;
+
+  if((mem = kallocwait(v->f == 0)) == 0)
+    return -1;
+  if(v->f){
+    ilock(v->f->ip);
+    n = readi(v->f->ip, mem, off, PGSIZE);
+    iunlock(v->f->ip);
+    // 파일 끝 너머는 0으로 채운다
+    if(n < 0)
+      n = 0;
+    memset(mem + n, 0, PGSIZE - n);
+  }
+  if(v->sh && (mem = shadd(v->sh, off, mem)) == 0)
+    return -1;
+
+map:
+  if(mapuvm(p->pgdir, va, mem, perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Map len bytes of f starting at off (or anonymous memory) into the
+// current process.  Without MAP_FIXED, addr is only a hint, used if
+// the range there is free.  Returns the start address or -1.
+int
+mmap(uint addr, int len, int prot, int flags, struct file *f, int off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint size;
+  int type;
+
+  if(len <= 0 || off < 0 || off % PGSIZE != 0 || !(prot & PROT_READ))
+    return -1;
+  if(!(flags & MAP_SHARED) == !(flags & MAP_PRIVATE))
+    return -1;
+  // vfork 자식은 부모의 address space를 빌려 쓰는 중이다
+  if(p->vforked)
+    return -1;
+
+  if(flags & MAP_ANONYMOUS)
+    f = 0;
+  else {
+    if(f == 0 || f->type != FD_INODE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+    ilock(f->ip);
+    type = f->ip->type;
+    iunlock(f->ip);
+    if(type != T_FILE)
+      return -1;
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end == 0)
+      break;
+  if(v == &p->vma[NVMA])
+    return -1;
+
+  size = PGROUNDUP((uint)len);
+  if(addr % PGSIZE != 0 || addr < MMAPBASE || addr + size > KERNBASE ||
+     addr + size < addr || overlaps(p, addr, addr + size)){
+    if(flags & MAP_FIXED)
+      return -1;
+    if((addr = findgap(p, size)) == 0)
+      return -1;
+  }
+
+  v->start = addr;
+  v->end = addr + size;
+  v->prot = prot & (PROT_READ|PROT_WRITE);
+  v->flags = flags & (MAP_SHARED|MAP_PRIVATE);
+  v->f = f ? filedup(f) : 0;
+  v->off = off;
+  v->sh = 0;
+  return addr;
+}
+
+// Unmap [addr, addr+len) from the current process.  The range may
+// cover several regions or parts of them.  Returns 0, or -1 if the
+// arguments are bad or a region would have to be split and there is
+// no free slot.
+int
+munmap(uint addr, int len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *nv;
+  uint end, s, e;
+
+  if(len <= 0 || addr % PGSIZE != 0 || addr < MMAPBASE)
+    return -1;
+  // vfork 자식의 region은 부모 것이다
+  if(p->vforked)
+    return -1;
+  end = addr + PGROUNDUP((uint)len);
+  if(end > KERNBASE || end < addr)
+    return -1;
+
+  // 한 region의 가운데를 잘라내면 slot이 하나 더 필요하다
+  nv = 0;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end && v->start < addr && end < v->end){
+      for(nv = p->vma; nv < &p->vma[NVMA]; nv++)
+        if(nv->end == 0)
+          break;
+      if(nv == &p->vma[NVMA])
+        return -1;
+    }
+  }
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0 || v->end <= addr || end <= v->start)
+      continue;
+    s = v->start > addr ? v->start : addr;
+    e = v->end < end ? v->end : end;
+    vmaflush(p, v, s, e);
+    deallocuvm(p->pgdir, e, s);
+    if(s == v->start && e == v->end){
+      vmaput(v);
+    } else if(s == v->start){
+      v->off += e - v->start;
+      v->start = e;
+    } else if(e == v->end){
+      v->end = s;
+    } else {
+      *nv = *v;
+      nv->off += e - v->start;
+      nv->start = e;
+      vmadup(nv);
+      v->end = s;
+    }
+  }
+  return 0;
+}
+
+// Page fault at va above sz: fault in the page if va is in one of
+// the current process's regions.  Returns 0 if handled, -1 if not.
+int
+mmapfault(uint va, int write)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  va = PGROUNDDOWN(va);
+  if((v = findvma(p, va)) == 0)
+    return -1;
+  if(write && !(v->prot & PROT_WRITE))
+    return -1;
+  if(uva2ka(p->pgdir, (char*)va) != 0)
+    return -1;
+  if(vmafill(p, v, va, write) < 0)
+    return -1;
+  countfault(v->f ? VM_FAULT_FILE : VM_FAULT_ZERO);
+  return 0;
+}
+
+// A copy of region v was made: take references to its file and
+// shared pages.
+void
+vmadup(struct vma *v)
+{
+  if(v->f)
+    filedup(v->f);
+  if(v->sh){
+    acquire(&shtab.lock);
+    v->sh->ref++;
+    release(&shtab.lock);
+  }
+}
+
+// Drop region v's references and free its slot.
+static void
+vmaput(struct vma *v)
+{
+  if(v->f)
+    fileclose(v->f);
+  if(v->sh)
+    shput(v->sh);
+  v->f = 0;
+  v->sh = 0;
+  v->end = 0;
+}
+
+// Copy p's regions to np on fork.  np->pgdir must already be set.
+// Only pages p has mapped are copied; shared regions get a vmshare
+// first, so that pages faulted in later are shared too.  Returns the
+// number of pages in writable shared regions, which are not
+// copy-on-write (see memfork), or -1, with no region copied, if out
+// of memory.
+int
+vmacopy(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i, n, wshared;
+
+  wshared = 0;
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(v->end == 0)
+      continue;
+    if((v->flags & MAP_SHARED) && v->sh == 0 && shcreate(p, v) < 0)
+      goto bad;
+    if((n = copyrange(p->pgdir, np->pgdir, v->start, v->end,
+                      v->flags & MAP_SHARED)) < 0)
+      goto bad;
+    if((v->flags & MAP_SHARED) && (v->prot & PROT_WRITE))
+      wshared += n;
+    np->vma[i] = *v;
+    vmadup(&np->vma[i]);
+  }
+  return wshared;
+
+bad:
+  for(i = 0; i < NVMA; i++)
+    if(np->vma[i].end)
+      vmaput(&np->vma[i]);
+  return -1;
+}
+
+// Drop all of p's regions, writing shared file pages back.  Used by
+// exit and exec; the pages themselves are freed with the page table.
+// A vfork child only drops its view of the parent's regions, which
+// the parent writes back itself.
+void
+vmafreeall(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->end == 0)
+      continue;
+    if(!p->vforked)
+      vmaflush(p, v, v->start, v->end);
+    vmaput(v);
+  }
+}
+
+// Return the end of the run of adjacent regions of p starting at
+// the one that contains va (only writable ones if write), or 0 if
+// there is none.  System calls use this to check user pointers
+// above sz.
+uint
+vmalimit(struct proc *p, uint va, int write)
+{
+  struct vma *v;
+  uint end;
+
+  end = 0;
+  while((v = findvma(p, va)) != 0 && (!write || (v->prot & PROT_WRITE))){
+    end = v->end;
+    va = v->end;
+  }
+  return end;
+}
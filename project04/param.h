@@ -2,13 +2,21 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NIUNUSED     50  // unused in-memory inodes kept cached
+#define NVMA         16  // mmap regions per process
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NEXECSEG      4  // ELF segments paged in from the program file
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
+#define MAXORDER     10  // largest buddy block is 2^MAXORDER pages (4MB)
+#define SWAPDEV       0  // swap space is on the boot disk, after the kernel
+#define SWAPSTART  2048  // first swap block (1MB into the disk)
+#define NSWAPPAGE  4096  // pages of swap space (16MB)
+#define NCPAGE     1024  // pages in the program page cache
+#define NKSM        512  // slots in each same-page merging table
+#define COWAROUND     8  // CoW fault-around window in pages (power of 2, 1 = off)
 
@@ -0,0 +1,169 @@
+// Page cache for program files.
+//
+// exec does not read a program into memory; execfault (exec.c) reads
+// each page the first time it is touched.  Pages that are only read
+// are kept here, on a list per inode, and mapped read-only into every
+// process running the program, so ten instances of sh share one copy
+// of its text.  A write to such a page makes a private copy in
+// CoW_handler, as for any page whose reference count is above one.
+//
+// Each cached page holds one reference of its own.  Writing to the
+// file or freeing the in-memory inode (which stays cached for a while
+// after its last iput, see fs.c) drops its cached pages.  A program
+// file cannot be written while any process runs it (writei), so a
+// process never mixes pages of old and new contents.  kswapd drops
+// cached pages that no process maps when memory runs low.
+//
+// A page is identified by its file offset and by how many bytes of
+// it come from the file (the rest is zero), since program segments
+// need not start at a page-aligned offset or end on a page boundary.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+struct cpage {
+  struct inode *ip;    // 0 if free
+  uint off;            // file offset of the first byte
+  uint len;            // bytes read from the file
+  char *page;
+  struct cpage *next;  // next page of ip, or next free cpage
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage cpage[NCPAGE];
+  struct cpage *free;
+  int hand;            // where shrink looks next
+} pcache;
+
+void
+pcacheinit(void)
+{
+  struct cpage *c;
+
+  initlock(&pcache.lock, "pcache");
+  for(c = pcache.cpage; c < &pcache.cpage[NCPAGE]; c++){
+    c->next = pcache.free;
+    pcache.free = c;
+  }
+}
+
+// Remove *pp from its inode's list and free its page.
+// Caller holds pcache.lock.
+static void
+drop(struct cpage **pp)
+{
+  struct cpage *c;
+
+  c = *pp;
+  *pp = c->next;
+  kfree(c->page);
+  c->ip = 0;
+  c->next = pcache.free;
+  pcache.free = c;
+}
+
+// Drop up to n cached pages that no process maps, going round the
+// table like a clock.  Caller holds pcache.lock.
+static int
+shrink(int n)
+{
+  struct cpage *c, **pp;
+  int i, nfreed;
+
+  nfreed = 0;
+  for(i = 0; i < NCPAGE && nfreed < n; i++){
+    c = &pcache.cpage[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NCPAGE;
+    if(c->ip == 0 || get_refc(V2P(c->page)) != 1)
+      continue;
+    for(pp = &c->ip->pages; *pp != c; pp = &(*pp)->next)
+      ;
+    drop(pp);
+    nfreed++;
+  }
+  return nfreed;
+}
+
+// Return the page of ip at file offset off, with len bytes from the
+// file and the rest zero, holding a reference for the caller.  Reads
+// it in and caches it if it is not cached yet; if the table is full
+// of pages in use, the page is returned without being cached.
+// Returns 0 if out of memory or the file is too short.
+char*
+pcacheget(struct inode *ip, uint off, uint len)
+{
+  struct cpage *c;
+  char *mem;
+
+  // inode lock 덕분에 같은 page를 두 번 읽어 넣지 않는다
+  ilock(ip);
+  acquire(&pcache.lock);
+  for(c = ip->pages; c; c = c->next){
+    if(c->off == off && c->len == len){
+      incr_refc(V2P(c->page));
+      release(&pcache.lock);
+      iunlock(ip);
+      return c->page;
+    }
+  }
+  release(&pcache.lock);
+
+  if((mem = kallocwait(0)) == 0){
+    iunlock(ip);
+    return 0;
+  }
+  if(readi(ip, mem, off, len) != len){
+    iunlock(ip);
+    kfree(mem);
+    return 0;
+  }
+  memset(mem + len, 0, PGSIZE - len);
+
+  acquire(&pcache.lock);
+  if(pcache.free == 0)
+    shrink(1);
+  if((c = pcache.free) != 0){
+    pcache.free = c->next;
+    c->ip = ip;
+    c->off = off;
+    c->len = len;
+    c->page = mem;
+    c->next = ip->pages;
+    ip->pages = c;
+    incr_refc(V2P(mem));
+  }
+  release(&pcache.lock);
+  iunlock(ip);
+  return mem;
+}
+
+// Drop all of ip's cached pages.
+void
+pcacheinval(struct inode *ip)
+{
+  acquire(&pcache.lock);
+  while(ip->pages)
+    drop(&ip->pages);
+  release(&pcache.lock);
+}
+
+// Free up to n cached pages that no process maps.  Used by kswapd.
+// Returns the number freed.
+int
+pcacheshrink(int n)
+{
+  int nfreed;
+
+  acquire(&pcache.lock);
+  nfreed = shrink(n);
+  release(&pcache.lock);
+  return nfreed;
+}
@@ -6,6 +6,7 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "slab.h"
 #include "file.h"
 
 #define PIPESIZE 512
@@ -19,6 +20,16 @@ struct pipe {
   int writeopen;  // write fd is still open
 };
 
+// A struct pipe is about 600 bytes; a slab cache packs several
+// into a page instead of spending a whole page on each.
+static struct kmem_cache pipecache;
+
+void
+pipeinit(void)
+{
+  kmem_cache_init(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,7 +39,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = kmem_cache_alloc(&pipecache)) == 0)
     goto bad;
   p->readopen = 1;
   p->writeopen = 1;
@@ -48,7 +59,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -69,7 +80,7 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
   } else
     release(&p->lock);
 }
@@ -6,6 +6,8 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "spawn.h"
+#include "swap.h"
 
 struct {
   struct spinlock lock;
@@ -88,6 +90,7 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->pinned = 0;
 
   release(&ptable.lock);
 
@@ -115,6 +118,25 @@ found:
   return p;
 }
 
+// Start a kernel thread that runs fn, which must never return.
+// It has only the kernel mappings and no parent, files or cwd.
+struct proc*
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kthread");
+  // forkret이 trapret 대신 fn으로 return하도록 한다
+  *(uint*)((char*)p->context + sizeof(*p->context)) = (uint)fn;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+  return p;
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -130,6 +152,7 @@ userinit(void)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
   p->sz = PGSIZE;
+  memrecount(p);
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -163,14 +186,36 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // 주소 공간만 늘리고, 실제 page는 처음 접근할 때
+    // lazy_handler가 할당한다.
+    if(sz + n < sz || sz + n > MMAPBASE)
       return -1;
+    sz += n;
   } else if(n < 0){
+    // deallocuvm은 실제로 mapping된 page만 free한다.
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   }
   curproc->sz = sz;
-  switchuvm(curproc);
+  return 0;
+}
+
+// Grow current process's memory by at least n bytes of 4MB pages,
+// starting at the next 4MB boundary.  Return 0 on success, -1 on
+// failure.
+int
+growhuge(int n)
+{
+  uint sz;
+  struct proc *curproc = myproc();
+
+  sz = curproc->sz;
+  if(n <= 0 || HUGEPGROUNDUP(sz) < sz || HUGEPGROUNDUP(sz) + n < sz ||
+     HUGEPGROUNDUP(HUGEPGROUNDUP(sz) + n) > MMAPBASE)
+    return -1;
+  if((sz = hugeallocuvm(curproc->pgdir, sz, HUGEPGROUNDUP(sz) + n)) == 0)
+    return -1;
+  curproc->sz = sz;
   return 0;
 }
 
@@ -180,7 +225,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int i, pid, wshared;
   struct proc *np;
   struct proc *curproc = myproc();
 
@@ -196,6 +241,14 @@ fork(void)
     np->state = UNUSED;
     return -1;
   }
+  if((wshared = vmacopy(np, curproc)) < 0){
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  memfork(np, curproc, wshared);
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -207,6 +260,9 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  np->exe = curproc->exe;
+  if(np->exe.ip)
+    iexecdup(np->exe.ip);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -221,6 +277,189 @@ fork(void)
   return pid;
 }
 
+// Create a new process that borrows the parent's address space,
+// mmap regions included, instead of copying it.  The parent sleeps
+// until the child calls exec or exit, so the child may only use its
+// own stack frame before doing so.  Returns the child's pid to the
+// parent and 0 to the child.
+int
+vfork(void)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  // page table을 복사하지 않고 그대로 공유한다.
+  np->pgdir = curproc->pgdir;
+  np->sz = curproc->sz;
+  np->mem = curproc->mem;
+  np->vforkmem = curproc->mem;
+  np->vforked = 1;
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
+
+  // Clear %eax so that vfork returns 0 in the child.
+  np->tf->eax = 0;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  np->cwd = idup(curproc->cwd);
+  np->exe = curproc->exe;
+  if(np->exe.ip)
+    iexecdup(np->exe.ip);
+  // 같은 page table이므로 mmap 영역도 그대로 보이게 한다
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = curproc->vma[i];
+    if(np->vma[i].end)
+      vmadup(&np->vma[i]);
+  }
+
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+
+  // 자식이 exec 또는 exit으로 address space를 돌려줄 때까지 기다린다.
+  // 자식이 같은 user stack을 쓰고 있으므로 kill되어도 먼저 돌아가면 안 된다.
+  while(np->vforked)
+    sleep(np, &ptable.lock);
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Give a borrowed address space back to the vfork parent and wake
+// it.  sz and mem describe the address space as the child left it.
+// Caller must already have stopped using p->pgdir as its own (exec
+// installed a new one, or exit is about to zombie).
+static void
+vforkrelease(struct proc *p, uint sz, struct memcount *mem)
+{
+  struct memcount *pm = &p->parent->mem;
+
+  // 자식이 sbrk로 바꾼 크기와 그 사이 늘고 준 page 수를 부모 쪽에
+  // 반영한다.  부모의 count는 그 사이 kswapd 등이 바꿨을 수 있으므로
+  // 덮어쓰지 않고 차이만 더한다.
+  p->parent->sz = sz;
+  pm->rss += mem->rss - p->vforkmem.rss;
+  pm->cow += mem->cow - p->vforkmem.cow;
+  pm->ptp += mem->ptp - p->vforkmem.ptp;
+  p->vforked = 0;
+  wakeup1(p);
+}
+
+void
+vforkdone(struct proc *p, uint sz, struct memcount *mem)
+{
+  acquire(&ptable.lock);
+  vforkrelease(p, sz, mem);
+  release(&ptable.lock);
+}
+
+// Create a new process running the program at path with arguments
+// argv, without copying the caller's address space.  The child
+// starts with a copy of the caller's open files, then applies the
+// actions in acts (ending with SPAWN_END, or acts may be 0) to
+// them in order.  Returns the child's pid, or -1 on error.
+int
+spawn(char *path, char **argv, struct spawn_action *acts)
+{
+  int i, fd, pid;
+  uint entry, sp;
+  struct file *f;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  if(loaduser(path, argv, &np->pgdir, &np->sz, &entry, &sp,
+              np->name, sizeof(np->name), &np->exe) < 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  memrecount(np);
+  np->parent = curproc;
+
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+  np->tf->esp = sp;
+  np->tf->eip = entry;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+
+  for(i = 0; acts && i < SPAWN_MAXACT && acts[i].op != SPAWN_END; i++){
+    fd = acts[i].fd;
+    if(fd < 0 || fd >= NOFILE || (f = np->ofile[fd]) == 0)
+      goto bad;
+    switch(acts[i].op){
+    case SPAWN_DUP2:
+      if(acts[i].newfd < 0 || acts[i].newfd >= NOFILE)
+        goto bad;
+      if(acts[i].newfd == fd)
+        break;
+      if(np->ofile[acts[i].newfd])
+        fileclose(np->ofile[acts[i].newfd]);
+      np->ofile[acts[i].newfd] = filedup(f);
+      break;
+    case SPAWN_CLOSE:
+      fileclose(f);
+      np->ofile[fd] = 0;
+      break;
+    default:
+      goto bad;
+    }
+  }
+  np->cwd = idup(curproc->cwd);
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+
+  release(&ptable.lock);
+
+  return pid;
+
+bad:
+  for(i = 0; i < NOFILE; i++){
+    if(np->ofile[i]){
+      fileclose(np->ofile[i]);
+      np->ofile[i] = 0;
+    }
+  }
+  freevm(np->pgdir);
+  np->pgdir = 0;
+  begin_op();
+  iexecput(np->exe.ip);
+  end_op();
+  np->exe.ip = 0;
+  kfree(np->kstack);
+  np->kstack = 0;
+  np->parent = 0;
+  np->state = UNUSED;
+  return -1;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -234,7 +473,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
+  // Write back and drop mmap regions, then close all open files.
+  vmafreeall(curproc);
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
       fileclose(curproc->ofile[fd]);
@@ -244,11 +484,22 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe.ip)
+    iexecput(curproc->exe.ip);
   end_op();
   curproc->cwd = 0;
+  curproc->exe.ip = 0;
 
   acquire(&ptable.lock);
 
+  // 빌린 address space는 부모 것이므로 free하지 않고 돌려준다.
+  // sched()에서 scheduler가 switchkvm한 뒤에야 ptable.lock이 풀리므로
+  // 부모가 깨어나 pgdir을 free해도 안전하다.
+  if(curproc->vforked){
+    vforkrelease(curproc, curproc->sz, &curproc->mem);
+    curproc->pgdir = 0;
+  }
+
   // Parent might be sleeping in wait().
   wakeup1(curproc->parent);
 
@@ -289,7 +540,9 @@ wait(void)
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
+        if(p->pgdir)
+          freevm(p->pgdir);
+        p->pgdir = 0;
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -311,6 +564,86 @@ wait(void)
   }
 }
 
+// Is some running process using pgdir?  Caller must hold ptable.lock.
+static int
+pgdirbusy(pde_t *pgdir)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == RUNNING && p->pgdir == pgdir)
+      return 1;
+  return 0;
+}
+
+// May a kernel thread change p's page table behind its back?  Yes if
+// p is sleeping or runnable, is not pinned, and no process sharing
+// its page table is running.  Caller must hold ptable.lock, which
+// keeps p from starting to run until it is released.
+//
+// A process is pinned while it handles a page fault or is in a system
+// call other than wait and sleep (see trap.c and syscall.c).  Such a
+// process may hold a PTE, a page or a user buffer it has just faulted
+// in across a sleep, e.g. in kallocwait or in a pipe or console read
+// that then copies under a spin lock, where a fault cannot be handled.
+int
+procidle(struct proc *p)
+{
+  // 실행 중인 process의 page는 다른 CPU의 TLB에 있을 수 있다.
+  // ZOMBIE는 부모가 wait에서 곧 free한다.
+  return (p->state == SLEEPING || p->state == RUNNABLE) && p->pgdir &&
+         !p->pinned && !pgdirbusy(p->pgdir);
+}
+
+// Pick up to n pages to swap out, running the clock (swapscan) over
+// the memory of processes that are sleeping or runnable, starting
+// where the last call stopped.  Returns the number of pages in v.
+int
+swapvictims(struct victim *v, int n)
+{
+  static int hand;   // ptable slot the clock is in
+  static uint va;    // and the address in it
+  struct proc *p;
+  int i, nv;
+
+  nv = 0;
+  acquire(&ptable.lock);
+  for(i = 0; i <= NPROC; i++){
+    p = &ptable.proc[hand];
+    if(procidle(p))
+      nv += swapscan(p, &va, v + nv, n - nv);
+    if(nv == n)
+      break;
+    hand = (hand + 1) % NPROC;
+    va = 0;
+  }
+  release(&ptable.lock);
+  return nv;
+}
+
+// Look at up to n pages for same-page merging (ksmscan), going round
+// the memory of idle processes like swapvictims does.
+void
+ksmprocs(int n)
+{
+  static int hand;
+  static uint va;
+  struct proc *p;
+  int i;
+
+  acquire(&ptable.lock);
+  for(i = 0; i <= NPROC && n > 0; i++){
+    p = &ptable.proc[hand];
+    if(procidle(p))
+      n -= ksmscan(p, &va, n);
+    if(n <= 0)
+      break;
+    hand = (hand + 1) % NPROC;
+    va = 0;
+  }
+  release(&ptable.lock);
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -324,6 +657,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -331,10 +665,12 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -352,6 +688,9 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // 할 일이 없으면 free page를 미리 0으로 채워 둔다
+    if(!ran)
+      kzerofill();
   }
 }
 
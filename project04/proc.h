@@ -32,6 +32,41 @@ struct context {
   uint eip;
 };
 
+// A region mapped with mmap.  Pages are faulted in on demand
+// (mmapfault in mmap.c); end == 0 marks a free slot.
+struct vma {
+  uint start;                  // page aligned
+  uint end;
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // backing file, or 0 if anonymous
+  uint off;                    // file offset of start
+  struct vmshare *sh;          // MAP_SHARED pages, once forked (mmap.c)
+};
+
+// The part of a program segment that comes from the file: filesz
+// bytes at file offset off, mapped at va (page aligned).  Its pages
+// are read in on first touch by execfault (exec.c).
+struct execseg {
+  uint va;
+  uint filesz;
+  uint off;
+};
+
+struct execimg {
+  struct inode *ip;            // program file, or 0
+  int nseg;
+  struct execseg seg[NEXECSEG];
+};
+
+// Memory counts of a process, kept up to date as its page table
+// changes (see vm.c) so that reading them is cheap.
+struct memcount {
+  int rss;                     // resident user pages
+  int cow;                     // of those, mapped read-only
+  int ptp;                     // page table pages, with the page directory
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -49,6 +84,13 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  int vforked;                 // 부모의 pgdir을 빌려 쓰는 중 (vfork)
+  struct vma vma[NVMA];        // mmap regions
+  struct execimg exe;          // running program, for demand paging
+  struct memcount mem;         // memory counts
+  struct memcount vforkmem;    // mem when vfork lent the address space
+  int faultkind;               // VM_FAULT_* of the fault being handled
+  int pinned;                  // in a fault or system call; see procidle
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -56,3 +98,4 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// and mmap regions above MMAPBASE.
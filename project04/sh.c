@@ -52,6 +52,11 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+
+// Parse tree built by the vfork child in the shared heap.
+// The shell frees it once the child has exec'd or exited.
+struct cmd *vcmd;
 
 // Execute cmd.  Never returns.
 void
@@ -145,7 +150,7 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  int fd, pid;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,8 +169,18 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
+    // vfork: page table을 복사하지 않는다.  child가 exec 또는 exit할
+    // 때까지 shell은 멈춰 있으므로, child가 malloc한 parse tree를
+    // 돌아와서 free한다.
+    vcmd = 0;
+    pid = vfork();
+    if(pid == -1)
+      panic("vfork");
+    if(pid == 0){
+      vcmd = parsecmd(buf);
+      runcmd(vcmd);
+    }
+    freecmd(vcmd);
     wait();
   }
   exit();
@@ -256,6 +271,44 @@ backcmd(struct cmd *subcmd)
   cmd->cmd = subcmd;
   return (struct cmd*)cmd;
 }
+// Free a parse tree.  Strings point into the input buffer.
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
+
 //PAGEBREAK!
 // Parsing
 
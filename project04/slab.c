@@ -0,0 +1,173 @@
+// Slab allocator for small kernel objects (pipes, open files,
+// inodes, disk buffers).
+//
+// Each cache carves whole pages from kalloc into equal-size objects.
+// A page (a slab) starts with a struct slab header and keeps its own
+// list of free objects, so an object's slab is found by rounding its
+// address down to a page.  In front of the slabs every CPU has a
+// magazine of free objects: most allocs and frees just pop or push
+// it, and only move MAGSIZE/2 objects to or from the slabs (under
+// the cache lock) when it runs empty or full.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;     // in cache->partial
+  struct slab *prev;
+  void **free;           // free objects, linked through their first word
+  int inuse;             // objects handed out
+};
+
+#define SLABHDR  ((sizeof(struct slab) + 7) & ~7)
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  memset(c, 0, sizeof(*c));
+  c->name = name;
+  c->size = (size + 3) & ~3;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  if(c->perslab < 1)
+    panic("kmem_cache_init: object too big");
+  initlock(&c->lock, name);
+}
+
+static void
+slablink(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(s->next)
+    s->next->prev = s;
+  c->partial = s;
+}
+
+static void
+slabunlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Allocate a new slab page and put it on c->partial.
+// Caller must hold c->lock.
+static int
+slabgrow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return -1;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  for(i = c->perslab - 1; i >= 0; i--){
+    obj = (char*)s + SLABHDR + i*c->size;
+    *(void**)obj = s->free;
+    s->free = (void**)obj;
+  }
+  slablink(c, s);
+  c->nslab++;
+  c->nfree += c->perslab;
+  return 0;
+}
+
+// Take one object from the slabs.  Caller must hold c->lock.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  void **obj;
+
+  if(c->partial == 0 && slabgrow(c) < 0)
+    return 0;
+  s = c->partial;
+  obj = s->free;
+  s->free = (void**)*obj;
+  s->inuse++;
+  c->nfree--;
+  if(s->free == 0)
+    slabunlink(c, s);   // full
+  return obj;
+}
+
+// Return one object to its slab, and the slab's page to kalloc when
+// it is empty and the cache has another slab's worth of free objects.
+// Caller must hold c->lock.
+static void
+slabfree(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("kmem_cache_free");
+  if(s->free == 0)
+    slablink(c, s);     // was full
+  *(void**)obj = s->free;
+  s->free = (void**)obj;
+  s->inuse--;
+  c->nfree++;
+  if(s->inuse == 0 && c->nfree > 2*c->perslab){
+    slabunlink(c, s);
+    c->nslab--;
+    c->nfree -= c->perslab;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from c.  Its contents are undefined.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *obj;
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->mag[id].n == 0){
+    acquire(&c->lock);
+    while(c->mag[id].n < MAGSIZE/2 && (obj = slaballoc(c)) != 0)
+      c->mag[id].obj[c->mag[id].n++] = obj;
+    release(&c->lock);
+  }
+  obj = 0;
+  if(c->mag[id].n > 0)
+    obj = c->mag[id].obj[--c->mag[id].n];
+  popcli();
+  return obj;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  int id;
+
+  pushcli();
+  id = cpuid();
+  if(c->mag[id].n == MAGSIZE){
+    acquire(&c->lock);
+    while(c->mag[id].n > MAGSIZE/2)
+      slabfree(c, c->mag[id].obj[--c->mag[id].n]);
+    release(&c->lock);
+  }
+  c->mag[id].obj[c->mag[id].n++] = obj;
+  popcli();
+}
@@ -0,0 +1,20 @@
+// Object caches for small, fixed-size kernel objects.
+// Include after spinlock.h and param.h.
+
+#define MAGSIZE 16  // objects held by each per-CPU magazine
+
+struct slab;
+
+struct kmem_cache {
+  char *name;
+  uint size;             // object size in bytes
+  int perslab;           // objects per slab page
+  struct spinlock lock;  // protects partial, nslab, nfree
+  struct slab *partial;  // slabs with at least one free object
+  int nslab;             // slab pages allocated
+  int nfree;             // free objects in slabs (not magazines)
+  struct {               // per-CPU stack of free objects; only the
+    void *obj[MAGSIZE];  // owning CPU touches it, with interrupts off
+    int n;
+  } mag[NCPU];
+};
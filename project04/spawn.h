@@ -0,0 +1,14 @@
+// File actions for spawn().  The child starts with a copy of the
+// parent's open files; the actions are applied to that copy in
+// order, and the list ends with an entry whose op is SPAWN_END.
+#define SPAWN_END    0
+#define SPAWN_DUP2   1  // newfd = dup of fd (closing newfd first)
+#define SPAWN_CLOSE  2  // close fd
+
+#define SPAWN_MAXACT 16  // maximum actions per spawn
+
+struct spawn_action {
+  int op;
+  int fd;
+  int newfd;
+};
@@ -0,0 +1,235 @@
+// Swap space and page reclaim.
+//
+// When free memory runs low, the kswapd kernel thread runs a clock
+// over the pages of processes that are not running and not in the
+// middle of a page fault or system call (swapvictims and procidle in
+// proc.c, swapscan in vm.c).  A page used since the last pass only
+// loses its PTE_A bit; one that was not is unmapped, its PTE pointing
+// at a swap slot instead, then written to disk and freed.  A fault
+// on such a PTE (lazy_handler) reads the page back with swapin.
+// Before swapping anything, kswapd drops cached program pages that
+// no process maps (pcache.c), since those can be read again from the
+// file for free.
+//
+// Only pages with a reference count of 1 in a page table that is not
+// shared are taken, so a CoW-shared page is never split between
+// memory and swap.  A swap PTE can still end up in two page tables
+// when a shared page table is copied (ptunshare); each slot counts
+// the PTEs that hold it, and each copy reads in its own page.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "swap.h"
+
+struct {
+  struct spinlock lock;
+  ushort ref[NSWAPPAGE];   // PTEs holding the slot
+  uchar busy[NSWAPPAGE];   // being written out or read in
+  int rotor;               // where swapalloc looks next
+} swap;
+
+static void kswapd(void);
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  kthread("kswapd", kswapd);
+}
+
+// Allocate a slot for a page about to be written out.  The slot
+// starts busy, with one reference.  Returns -1 if swap is full.
+int
+swapalloc(void)
+{
+  int i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < NSWAPPAGE; i++){
+    s = (swap.rotor + i) % NSWAPPAGE;
+    if(swap.ref[s] == 0 && !swap.busy[s]){
+      swap.ref[s] = 1;
+      swap.busy[s] = 1;
+      swap.rotor = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Another PTE now holds slot.
+void
+swapdup(uint slot)
+{
+  acquire(&swap.lock);
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE holding slot went away.  The slot is free once it has no
+// references and no I/O in progress.
+void
+swapput(uint slot)
+{
+  acquire(&swap.lock);
+  if(swap.ref[slot] == 0)
+    panic("swapput");
+  swap.ref[slot]--;
+  release(&swap.lock);
+}
+
+// Read or write one page of swap through the disk driver.
+static void
+swapio(int write, uint slot, char *page)
+{
+  struct buf b;
+  int i;
+
+  memset(&b, 0, sizeof(b));
+  initsleeplock(&b.lock, "swapbuf");
+  acquiresleep(&b.lock);
+  b.dev = SWAPDEV;
+  for(i = 0; i < PGSIZE/BSIZE; i++){
+    b.blockno = SWAPSTART + slot*(PGSIZE/BSIZE) + i;
+    if(write){
+      memmove(b.data, page + i*BSIZE, BSIZE);
+      b.flags = B_DIRTY;
+    } else
+      b.flags = 0;
+    iderw(&b);
+    if(!write)
+      memmove(page + i*BSIZE, b.data, BSIZE);
+  }
+  releasesleep(&b.lock);
+}
+
+// Does the current CPU hold a spin lock (so it must not sleep)?
+static int
+holdinglocks(void)
+{
+  int n;
+
+  pushcli();
+  n = mycpu()->ncli;
+  popcli();
+  return n > 1;
+}
+
+// Allocate a page (zeroed if zero) for user memory.  If memory is
+// short, wait a while for kswapd to free some instead of failing
+// at once, unless the caller cannot sleep.
+char*
+kallocwait(int zero)
+{
+  char *mem;
+  int i;
+
+  for(i = 0; ; i++){
+    mem = zero ? kzalloc() : kalloc();
+    if(mem || i >= 100 || myproc() == 0 || myproc()->killed ||
+       holdinglocks())
+      return mem;
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+  }
+}
+
+// Bring the page for the swap PTE *pte back into memory.
+// Returns 0 on success (or if someone else already did), -1 if
+// out of memory or the caller holds a spin lock.
+int
+swapin(pte_t *pte)
+{
+  pte_t old;
+  uint slot;
+  char *mem;
+
+  if(holdinglocks()){
+    cprintf("swapin: page fault with lock held\n");
+    return -1;
+  }
+
+  acquire(&swap.lock);
+  for(;;){
+    old = *pte;
+    if(!(old & PTE_SWAP)){
+      // 다른 process가 (공유 page table에서) 먼저 읽어 왔다
+      release(&swap.lock);
+      return 0;
+    }
+    slot = SWAPSLOT(old);
+    if(!swap.busy[slot])
+      break;
+    sleep(&swap.busy[slot], &swap.lock);
+  }
+  swap.busy[slot] = 1;
+  release(&swap.lock);
+
+  mem = kallocwait(0);
+  if(mem)
+    swapio(0, slot, mem);
+
+  acquire(&swap.lock);
+  if(mem){
+    // not-present PTE는 TLB에 없으므로 flush할 필요 없다
+    *pte = V2P(mem) | PTE_P | (old & (PTE_W|PTE_U));
+    swap.ref[slot]--;
+    myproc()->mem.rss++;
+    if(!(old & PTE_W))
+      myproc()->mem.cow++;
+  }
+  swap.busy[slot] = 0;
+  wakeup(&swap.busy[slot]);
+  release(&swap.lock);
+  return mem ? 0 : -1;
+}
+
+// Write out up to n pages chosen by the clock and free them.
+// Returns the number of pages freed.
+static int
+swapout(int n)
+{
+  struct victim v[SWAPBATCH];
+  int i, nv;
+
+  if(n > SWAPBATCH)
+    n = SWAPBATCH;
+  nv = swapvictims(v, n);
+  for(i = 0; i < nv; i++){
+    swapio(1, v[i].slot, v[i].page);
+    acquire(&swap.lock);
+    swap.busy[v[i].slot] = 0;
+    wakeup(&swap.busy[v[i].slot]);
+    release(&swap.lock);
+    kfree(v[i].page);
+  }
+  return nv;
+}
+
+// Kernel thread: every tick, reclaim memory while it is short.
+static void
+kswapd(void)
+{
+  for(;;){
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+    // 아무도 mapping하지 않은 program page와 쓰지 않는 inode부터 버린다
+    while(countfp() < SWAPLOW &&
+          (pcacheshrink(SWAPBATCH) > 0 || icacheshrink(SWAPBATCH) > 0 ||
+           swapout(SWAPBATCH) > 0))
+      ;
+  }
+}
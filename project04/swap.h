@@ -0,0 +1,17 @@
+// A swapped-out page's PTE has PTE_P clear and PTE_SWAP set; its
+// address bits hold the swap slot, and PTE_W/PTE_U are kept so the
+// page comes back with the same permissions.
+#define SWAPSLOT(pte)   ((uint)(pte) >> PTXSHIFT)
+#define SWAPPTE(slot)   (((uint)(slot) << PTXSHIFT) | PTE_SWAP)
+
+#define SWAPBATCH  32   // pages kswapd writes out per pass
+// kswapd runs while fewer pages than this are free.  Must be well
+// above what the per-CPU caches can hold (NCPU*KCACHE_MAX), which
+// count as free but are out of reach of other CPUs.
+#define SWAPLOW  1024
+
+// A page picked by swapscan, to be written to slot and then freed.
+struct victim {
+  char *page;
+  uint slot;
+};
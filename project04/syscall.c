@@ -13,13 +13,28 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// Check that [addr, addr+n) is user memory of the current process:
+// below sz, or in mmap regions (writable ones if write).
+static int
+checkuser(uint addr, uint n, int write)
+{
+  struct proc *curproc = myproc();
+  uint lim;
+
+  if(addr < curproc->sz)
+    lim = curproc->sz;
+  else
+    lim = vmalimit(curproc, addr, write);
+  if(addr >= lim || n > lim - addr)
+    return -1;
+  return 0;
+}
+
 // Fetch the int at addr from the current process.
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
+  if(checkuser(addr, 4, 0) < 0)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -34,10 +49,11 @@ fetchstr(uint addr, char **pp)
   char *s, *ep;
   struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
+  if(addr < curproc->sz)
+    ep = (char*)curproc->sz;
+  else if((ep = (char*)vmalimit(curproc, addr, 0)) == 0)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
   for(s = *pp; s < ep; s++){
     if(*s == 0)
       return s - *pp;
@@ -59,11 +75,26 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(size < 0 || checkuser(i, size, 0) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like argptr, for a block the kernel will write to.  A read-only
+// mmap region is refused: a kernel write there would fault with no
+// way to recover.
+int
+argoutptr(int n, char **pp, int size)
+{
+  int i;
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || checkuser(i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -71,8 +102,9 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (Only a MAP_SHARED region can be written by another process, so
+// the string can't otherwise change between this check and being
+// used by the kernel.)
 int
 argstr(int n, char **pp)
 {
@@ -109,6 +141,16 @@ extern int sys_countfp(void);
 extern int sys_countvp(void);
 extern int sys_countpp(void);
 extern int sys_countptp(void);
+extern int sys_vfork(void);
+extern int sys_spawn(void);
+extern int sys_hsbrk(void);
+extern int sys_buddyinfo(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_memstat(void);
+extern int sys_vmstat(void);
+extern int sys_ksm(void);
+extern int sys_faulthist(void);
 
 
 static int (*syscalls[])(void) = {
@@ -139,17 +181,31 @@ static int (*syscalls[])(void) = {
 [SYS_countvp] sys_countvp,
 [SYS_countpp] sys_countpp,
 [SYS_countptp] sys_countptp,
+[SYS_vfork]   sys_vfork,
+[SYS_spawn]   sys_spawn,
+[SYS_hsbrk]   sys_hsbrk,
+[SYS_buddyinfo] sys_buddyinfo,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_memstat] sys_memstat,
+[SYS_vmstat]  sys_vmstat,
+[SYS_ksm]     sys_ksm,
+[SYS_faulthist] sys_faulthist,
 };
 
 void
 syscall(void)
 {
-  int num;
+  int num, pin;
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
+    // wait와 sleep은 user memory를 쓰지 않으니 그동안은 swap해도 된다
+    pin = num != SYS_wait && num != SYS_sleep;
+    curproc->pinned += pin;
     curproc->tf->eax = syscalls[num]();
+    curproc->pinned -= pin;
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
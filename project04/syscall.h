@@ -26,3 +26,13 @@
 #define SYS_countvp 25
 #define SYS_countpp 26
 #define SYS_countptp 27
+#define SYS_vfork  28
+#define SYS_spawn  29
+#define SYS_hsbrk  30
+#define SYS_buddyinfo 31
+#define SYS_mmap   32
+#define SYS_munmap 33
+#define SYS_memstat 34
+#define SYS_vmstat 35
+#define SYS_ksm    36
+#define SYS_faulthist 37
@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -73,8 +75,9 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argoutptr(1, &p, n) < 0)
     return -1;
+  prefault(p, n, 1);
   return fileread(f, p, n);
 }
 
@@ -87,6 +90,7 @@ sys_write(void)
 
   if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
     return -1;
+  prefault(p, n, 0);
   return filewrite(f, p, n);
 }
 
@@ -109,7 +113,7 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argoutptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -419,6 +423,48 @@ sys_exec(void)
   return exec(path, argv);
 }
 
+int
+sys_spawn(void)
+{
+  char *path, *argv[MAXARG];
+  struct spawn_action acts[SPAWN_MAXACT];
+  int i;
+  uint uargv, uarg, uacts;
+
+  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0 ||
+     argint(2, (int*)&uacts) < 0){
+    return -1;
+  }
+  memset(argv, 0, sizeof(argv));
+  for(i=0;; i++){
+    if(i >= NELEM(argv))
+      return -1;
+    if(fetchint(uargv+4*i, (int*)&uarg) < 0)
+      return -1;
+    if(uarg == 0){
+      argv[i] = 0;
+      break;
+    }
+    if(fetchstr(uarg, &argv[i]) < 0)
+      return -1;
+  }
+
+  // uacts == 0이면 file action 없이 부모의 fd를 그대로 물려준다.
+  acts[0].op = SPAWN_END;
+  for(i=0; uacts; i++){
+    if(i >= SPAWN_MAXACT)
+      return -1;
+    if(fetchint(uacts+sizeof(acts[0])*i, &acts[i].op) < 0)
+      return -1;
+    if(acts[i].op == SPAWN_END)
+      break;
+    if(fetchint(uacts+sizeof(acts[0])*i+4, &acts[i].fd) < 0 ||
+       fetchint(uacts+sizeof(acts[0])*i+8, &acts[i].newfd) < 0)
+      return -1;
+  }
+  return spawn(path, argv, acts);
+}
+
 int
 sys_pipe(void)
 {
@@ -426,7 +472,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argoutptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -442,3 +488,30 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// mmap(addr, len, prot, flags, fd, off).  fd is ignored for
+// MAP_ANONYMOUS.
+int
+sys_mmap(void)
+{
+  int addr, len, prot, flags, fd, off;
+  struct file *f;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argint(5, &off) < 0)
+    return -1;
+  f = 0;
+  if(!(flags & MAP_ANONYMOUS) && argfd(4, 0, &f) < 0)
+    return -1;
+  return mmap(addr, len, prot, flags, f, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "memstat.h"
+#include "vmstat.h"
 
 int
 sys_fork(void)
@@ -13,6 +15,12 @@ sys_fork(void)
   return fork();
 }
 
+int
+sys_vfork(void)
+{
+  return vfork();
+}
+
 int
 sys_exit(void)
 {
@@ -61,6 +69,22 @@ sys_sbrk(void)
   return addr;
 }
 
+// Like sbrk, but backed by 4MB pages.  Returns the start of the
+// new memory, which is 4MB-aligned.
+int
+sys_hsbrk(void)
+{
+  int addr;
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  addr = HUGEPGROUNDUP(myproc()->sz);
+  if(growhuge(n) < 0)
+    return -1;
+  return addr;
+}
+
 int
 sys_sleep(void)
 {
@@ -114,6 +138,17 @@ sys_countfp(void){
 
 }
 
+// free block 수를 order별로 user 배열(MAXORDER+1개)에 복사
+int
+sys_buddyinfo(void)
+{
+  int *nfree;
+
+  if(argoutptr(0, (void*)&nfree, (MAXORDER+1)*sizeof(nfree[0])) < 0)
+    return -1;
+  return buddyinfo(nfree);
+}
+
 int
 sys_countvp(void){
 
@@ -135,3 +170,62 @@ sys_countptp(void){
 
 }
 
+// 호출한 프로세스의 page 수들. page table을 훑지 않고
+// proc에 유지되는 값을 그대로 복사한다.
+int
+sys_memstat(void)
+{
+  struct memstat *ms;
+  struct proc *p = myproc();
+  struct vma *v;
+
+  if(argoutptr(0, (void*)&ms, sizeof(*ms)) < 0)
+    return -1;
+  ms->vp = PGROUNDUP(p->sz) / PGSIZE;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->end)
+      ms->vp += (v->end - v->start) / PGSIZE;
+  ms->rss = p->mem.rss;
+  ms->cow = p->mem.cow;
+  ms->ptp = p->mem.ptp;
+  ms->fp = countfp();
+  return 0;
+}
+
+// 모든 CPU의 vm event counter를 합쳐서 user에게 복사
+int
+sys_vmstat(void)
+{
+  struct vmstat *st;
+
+  if(argoutptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  vmstatsum(st);
+  return 0;
+}
+
+// same-page merging을 켜거나(1) 끈다(0).
+// 지금까지 합친 page 수를 return
+int
+sys_ksm(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return ksmctl(on != 0);
+}
+
+// page fault latency histogram을 user에게 복사하고,
+// 두 번째 인자가 0이 아니면 0으로 되돌린다
+int
+sys_faulthist(void)
+{
+  struct faulthist *h;
+  int reset;
+
+  if(argoutptr(0, (void*)&h, sizeof(*h)) < 0 || argint(1, &reset) < 0)
+    return -1;
+  faulthist(h, reset);
+  return 0;
+}
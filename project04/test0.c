@@ -12,7 +12,9 @@ main(int argc, char* argv[])
   int numpp = countpp();
   int numptp = countptp();
 
-  sbrk(4096);
+  // sbrk는 주소 공간만 늘리므로, 접근해야 page가 할당된다
+  char *heap = sbrk(4096);
+  heap[0] = 1;
 
   int numfpa = countfp();
   int numvpa = countvp();
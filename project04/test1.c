@@ -16,7 +16,7 @@ main(int argc, char *argv[])
   if(pid == 0){
     child_fp = countfp();
     
-    if(parent_fp - child_fp == 68)
+    if(parent_fp - child_fp == 5)
       printf(1, "[Test 1] pass\n\n");
     else
       printf(1, "[Test 1] fail\n\n");
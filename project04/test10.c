@@ -0,0 +1,55 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memstat.h"
+
+#define PGSIZE 4096
+#define NPAGE  16   // 4가지 내용이 4번씩
+#define NZERO  4
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 10] same-page merging\n");
+  struct memstat m0, m;
+  int i, j, merged, fail = 0;
+  char *a;
+
+  a = sbrk((NPAGE + NZERO) * PGSIZE);
+  for(i = 0; i < NPAGE; i++)
+    for(j = 0; j < PGSIZE; j++)
+      a[i * PGSIZE + j] = 'a' + i % 4;
+  // 한 번 썼다가 다시 0으로 만든 page
+  for(i = NPAGE; i < NPAGE + NZERO; i++){
+    a[i * PGSIZE] = 1;
+    a[i * PGSIZE] = 0;
+  }
+
+  memstat(&m0);
+  merged = ksm(1);
+  // ksmd가 두 번 이상 지나가야 합쳐지므로 잠깐씩 잔다
+  for(i = 0; i < 50; i++){
+    sleep(20);
+    memstat(&m);
+    if(m.cow - m0.cow >= NPAGE + NZERO)
+      break;
+  }
+  merged = ksm(0) - merged;
+  printf(1, "merged %d, cow %d -> %d, free %d -> %d\n",
+         merged, m0.cow, m.cow, m0.fp, m.fp);
+  if(m.cow - m0.cow < NPAGE + NZERO || m.fp - m0.fp < NPAGE - 4 + NZERO)
+    fail = 1;
+
+  // 합쳐진 page에 write하면 자기 copy가 생긴다
+  a[0] = 'X';
+  a[NPAGE * PGSIZE] = 'Z';
+  if(a[0] != 'X' || a[4 * PGSIZE] != 'a' || a[8 * PGSIZE + 1] != 'a' ||
+     a[NPAGE * PGSIZE] != 'Z' || a[(NPAGE + 1) * PGSIZE] != 0)
+    fail = 1;
+
+  if(fail)
+    printf(1, "[Test 10] fail\n\n");
+  else
+    printf(1, "[Test 10] pass\n\n");
+  exit();
+}
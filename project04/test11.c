@@ -0,0 +1,59 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "vmstat.h"
+
+#define PGSIZE 4096
+#define NPAGE  32
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 11] CoW fault-around\n");
+  struct vmstat s0, s;
+  int i, faults, around, fail = 0, fd[2];
+  char *a, c;
+
+  a = sbrk(NPAGE * PGSIZE);
+  for(i = 0; i < NPAGE; i++)
+    a[i * PGSIZE] = 'p';
+
+  pipe(fd);
+  if(fork() == 0){
+    // 순서대로 쓰면 window마다 한 번만 fault가 나야 한다
+    vmstat(&s0);
+    for(i = 0; i < NPAGE; i++)
+      a[i * PGSIZE] = 'c';
+    vmstat(&s);
+    faults = (s.n[VM_FAULT_COPY] - s0.n[VM_FAULT_COPY]) +
+             (s.n[VM_FAULT_REUSE] - s0.n[VM_FAULT_REUSE]);
+    around = s.n[VM_COW_AROUND] - s0.n[VM_COW_AROUND];
+    printf(1, "child: %d faults, %d pages around\n", faults, around);
+    // 다른 process의 fault도 섞일 수 있으니 조금 여유를 둔다
+    if(faults > NPAGE / COWAROUND + 4 || around < NPAGE - NPAGE / COWAROUND - 2)
+      fail = 1;
+    for(i = 0; i < NPAGE; i++)
+      if(a[i * PGSIZE] != 'c')
+        fail = 1;
+    c = fail;
+    write(fd[1], &c, 1);
+    exit();
+  }
+  if(read(fd[0], &c, 1) != 1 || c != 0)
+    fail = 1;
+  wait();
+  close(fd[0]);
+  close(fd[1]);
+
+  // child가 미리 복사해 간 page 때문에 부모 내용이 바뀌면 안 된다
+  for(i = 0; i < NPAGE; i++)
+    if(a[i * PGSIZE] != 'p')
+      fail = 1;
+
+  if(fail)
+    printf(1, "[Test 11] fail\n\n");
+  else
+    printf(1, "[Test 11] pass\n\n");
+  exit();
+}
@@ -0,0 +1,66 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+#define NPAGE 8
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 12] pipe read with memory exhausted\n");
+  int i, n, got, pid, fd[2], fail = 0;
+  char *fill, *buf;
+  char data[PGSIZE];
+
+  pipe(fd);
+  pid = fork();
+  if(pid == 0){
+    close(fd[0]);
+    // 부모가 memory를 다 쓸 때까지 기다렸다가 보낸다
+    sleep(200);
+    for(i = 0; i < NPAGE; i++){
+      memset(data, 'a' + i, PGSIZE);
+      write(fd[1], data, PGSIZE);
+    }
+    exit();
+  }
+  close(fd[1]);
+
+  // free page를 모두 써 버린다
+  n = countfp();
+  fill = sbrk(n * PGSIZE);
+  if(fill == (char*)-1){
+    printf(1, "[Test 12] fail\n\n");
+    exit();
+  }
+  for(i = 0; i < n; i++)
+    fill[i * PGSIZE] = i;
+  printf(1, "filled %d pages, %d free\n", n, countfp());
+
+  // 아직 건드리지 않은 sbrk buffer로 읽으면 pipe lock을 잡은 채
+  // page를 쓰게 된다
+  buf = sbrk(NPAGE * PGSIZE);
+  for(got = 0; got < NPAGE * PGSIZE; got += n){
+    if((n = read(fd[0], buf + got, NPAGE * PGSIZE - got)) <= 0)
+      break;
+  }
+  close(fd[0]);
+  wait();
+  printf(1, "read %d bytes\n", got);
+  if(got != NPAGE * PGSIZE)
+    fail = 1;
+  for(i = 0; i < got; i++){
+    if(buf[i] != 'a' + i / PGSIZE){
+      fail = 1;
+      break;
+    }
+  }
+
+  if(fail)
+    printf(1, "[Test 12] fail\n\n");
+  else
+    printf(1, "[Test 12] pass\n\n");
+
+  exit();
+}
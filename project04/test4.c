@@ -0,0 +1,75 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "spawn.h"
+#include "mman.h"
+
+int shared_data = 0;
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 4] vfork and spawn\n");
+  int pid, fail = 0;
+
+  // vfork child는 부모의 메모리를 공유하므로 free page가 줄지 않고,
+  // child가 쓴 값이 부모에게 보여야 한다.
+  int parent_initial_fp = countfp();
+  pid = vfork();
+  if(pid == 0){
+    shared_data = 1;
+    exit();
+  }
+  wait();
+  printf(1, "vfork: shared_data %d, fp diff %d\n", shared_data,
+         parent_initial_fp - countfp());
+  if(pid < 0 || shared_data != 1 || parent_initial_fp - countfp() != 0)
+    fail = 1;
+
+  // vfork child도 부모의 mmap 영역을 쓸 수 있어야 한다.
+  // 아직 건드리지 않은 page라 child에서 fault가 난다.
+  char *m = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  pid = vfork();
+  if(pid == 0){
+    m[0] = 'v';
+    exit();
+  }
+  wait();
+  printf(1, "vfork mmap: %c\n", m[0]);
+  if(m == MAP_FAILED || pid < 0 || m[0] != 'v')
+    fail = 1;
+  munmap(m, 4096);
+
+  // spawn한 echo의 stdout을 pipe로 돌려서 읽는다.
+  int p[2], n;
+  char buf[16];
+  char *echo_argv[] = { "echo", "hi", 0 };
+  struct spawn_action acts[3];
+
+  pipe(p);
+  acts[0].op = SPAWN_DUP2;
+  acts[0].fd = p[1];
+  acts[0].newfd = 1;
+  acts[1].op = SPAWN_CLOSE;
+  acts[1].fd = p[1];
+  acts[2].op = SPAWN_END;
+  pid = spawn("echo", echo_argv, acts);
+  close(p[1]);
+  memset(buf, 0, sizeof(buf));
+  n = read(p[0], buf, sizeof(buf) - 1);
+  close(p[0]);
+  wait();
+  printf(1, "spawn: read %d bytes\n", n);
+  if(pid < 0 || n != 3 || strcmp(buf, "hi\n") != 0)
+    fail = 1;
+
+  if(spawn("no-such-program", echo_argv, 0) >= 0)
+    fail = 1;
+
+  if(fail)
+    printf(1, "[Test 4] fail\n\n");
+  else
+    printf(1, "[Test 4] pass\n\n");
+
+  exit();
+}
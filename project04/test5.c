@@ -0,0 +1,46 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define HUGE (4*1024*1024)
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 5] 4MB pages\n");
+  int pid, fail = 0;
+
+  int numptp = countptp();
+  char *heap = hsbrk(HUGE);
+  int numptpa = countptp();
+
+  // 4MB page는 page table 없이 page directory에 바로 mapping된다
+  printf(1, "ptp: %d %d\n", numptp, numptpa);
+  if(heap == (char*)-1 || (uint)heap % HUGE != 0 || numptp != numptpa)
+    fail = 1;
+  if(countvp() != countpp())
+    fail = 1;
+
+  heap[0] = 1;
+  heap[HUGE - 1] = 2;
+
+  // fork 후에 child가 write하면 4MB 전체가 복사되고,
+  // 부모의 값은 그대로 남아 있어야 한다
+  pid = fork();
+  if(pid == 0){
+    heap[0] = 3;
+    if(heap[0] != 3 || heap[HUGE - 1] != 2)
+      printf(1, "[Test 5] fail\n\n");
+    exit();
+  }
+  wait();
+  if(heap[0] != 1 || heap[HUGE - 1] != 2)
+    fail = 1;
+
+  if(fail)
+    printf(1, "[Test 5] fail\n\n");
+  else
+    printf(1, "[Test 5] pass\n\n");
+
+  exit();
+}
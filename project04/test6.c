@@ -0,0 +1,38 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 6] swap\n");
+  int i, n, fail = 0;
+
+  // free page보다 1024 page 더 많이 쓰면 일부는 swap으로 나가야 한다
+  n = countfp() + 1024;
+  char *mem = sbrk(n * PGSIZE);
+  if(mem == (char*)-1){
+    printf(1, "[Test 6] fail\n\n");
+    exit();
+  }
+
+  for(i = 0; i < n; i++)
+    *(int*)(mem + i * PGSIZE) = i;
+  printf(1, "wrote %d pages, %d free\n", n, countfp());
+
+  for(i = 0; i < n; i++){
+    if(*(int*)(mem + i * PGSIZE) != i){
+      fail = 1;
+      break;
+    }
+  }
+
+  if(fail)
+    printf(1, "[Test 6] fail\n\n");
+  else
+    printf(1, "[Test 6] pass\n\n");
+
+  exit();
+}
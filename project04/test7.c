@@ -0,0 +1,104 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+
+#define PGSIZE 4096
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 7] mmap\n");
+  int i, fd, pid, fp, used, fail = 0;
+  char *a, *b, *f;
+  char buf[100];
+
+  // private anonymous: fork 후 child의 write는 부모에게 보이지 않는다
+  a = mmap(0, 3 * PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf(1, "[Test 7] fail\n\n");
+    exit();
+  }
+  if(a[PGSIZE] != 0)
+    fail = 1;
+  a[0] = 'p';
+  pid = fork();
+  if(pid == 0){
+    a[0] = 'c';
+    exit();
+  }
+  wait();
+  printf(1, "private: %c\n", a[0]);
+  if(a[0] != 'p')
+    fail = 1;
+
+  // shared anonymous: child의 write가 부모에게 보여야 한다
+  b = mmap(0, 2 * PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(b == MAP_FAILED)
+    fail = 1;
+  pid = fork();
+  if(pid == 0){
+    b[0] = 'c';
+    b[PGSIZE] = 'c';
+    exit();
+  }
+  wait();
+  printf(1, "shared: %c %c\n", b[0], b[PGSIZE]);
+  if(b[0] != 'c' || b[PGSIZE] != 'c')
+    fail = 1;
+  if(munmap(a, 3 * PGSIZE) < 0 || munmap(b, 2 * PGSIZE) < 0)
+    fail = 1;
+
+  // 건드리지 않은 shared region은 fork해도 page를 할당하지 않는다
+  b = mmap(0, 256 * PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  fp = countfp();
+  pid = fork();
+  if(pid == 0){
+    b[100 * PGSIZE] = 'c';
+    exit();
+  }
+  used = fp - countfp();
+  wait();
+  printf(1, "shared fork: %c\n", b[100 * PGSIZE]);
+  if(b == MAP_FAILED || used >= 256 || b[100 * PGSIZE] != 'c')
+    fail = 1;
+  munmap(b, 256 * PGSIZE);
+
+  // file: 2 page짜리 파일을 shared로 mapping해서 고치고 munmap하면
+  // 파일에 반영되어야 한다
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  for(i = 0; i < 2 * PGSIZE / sizeof(buf); i++)
+    write(fd, buf, sizeof(buf));
+  f = mmap(0, 2 * PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(f == MAP_FAILED || f[0] != 'a' || f[PGSIZE + 1] != 'a' + (PGSIZE + 1) % 100 % 26)
+    fail = 1;
+  f[PGSIZE] = 'X';
+  // mapping된 memory를 그대로 write에 넘길 수 있다
+  if(write(1, f, 5) != 5)
+    fail = 1;
+  printf(1, "\n");
+  munmap(f, 2 * PGSIZE);
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  f = mmap(0, 2 * PGSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  printf(1, "file: %c\n", f[PGSIZE]);
+  if(f == MAP_FAILED || f[PGSIZE] != 'X')
+    fail = 1;
+  // read only mapping에는 read()로도 쓸 수 없다
+  if(read(fd, f, 10) != -1)
+    fail = 1;
+  munmap(f, 2 * PGSIZE);
+  close(fd);
+  unlink("mmapfile");
+
+  if(fail)
+    printf(1, "[Test 7] fail\n\n");
+  else
+    printf(1, "[Test 7] pass\n\n");
+
+  exit();
+}
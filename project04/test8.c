@@ -0,0 +1,52 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+
+// 실행 파일 안에 들어 있는 read only data (8 page)
+const char table[8 * PGSIZE] = { 1 };
+
+int
+touch(void)
+{
+  int i, sum = 0;
+
+  for(i = 0; i < 8; i++)
+    sum += table[i * PGSIZE];
+  return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fp;
+  char *child_argv[] = { "test8", "child", 0 };
+
+  if(argc > 1){
+    // 부모가 이미 읽은 page는 page cache에서 공유하므로
+    // 읽어도 free page가 줄지 않아야 한다
+    fp = countfp();
+    touch();
+    fp -= countfp();
+    printf(1, "child: %d pages for table\n", fp);
+    if(fp == 0)
+      printf(1, "[Test 8] pass\n\n");
+    else
+      printf(1, "[Test 8] fail\n\n");
+    exit();
+  }
+
+  printf(1, "[Test 8] shared program pages\n");
+  if(touch() != 1){
+    printf(1, "[Test 8] fail\n\n");
+    exit();
+  }
+  if(fork() == 0){
+    exec("test8", child_argv);
+    printf(1, "[Test 8] fail\n\n");
+    exit();
+  }
+  wait();
+  exit();
+}
@@ -0,0 +1,66 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memstat.h"
+
+#define PGSIZE 4096
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "[Test 9] memstat\n");
+  struct memstat m0, m;
+  int i, pid, fail = 0, fd[2];
+  char *a, c;
+
+  memstat(&m0);
+  printf(1, "vp %d rss %d cow %d ptp %d fp %d\n", m0.vp, m0.rss, m0.cow, m0.ptp, m0.fp);
+
+  // sbrk는 lazy하므로 만지기 전에는 virtual page만 늘어난다
+  a = sbrk(4 * PGSIZE);
+  memstat(&m);
+  if(m.vp != m0.vp + 4 || m.rss != m0.rss)
+    fail = 1;
+  for(i = 0; i < 4; i++)
+    a[i * PGSIZE] = i;
+  memstat(&m);
+  if(m.rss != m0.rss + 4 || m.rss != countpp())
+    fail = 1;
+
+  pipe(fd);
+  pid = fork();
+  if(pid == 0){
+    // fork 직후에는 모든 page가 copy-on-write
+    memstat(&m);
+    printf(1, "child: rss %d cow %d\n", m.rss, m.cow);
+    if(m.cow != m.rss)
+      fail = 1;
+    m0 = m;
+    a[PGSIZE] = 9;
+    memstat(&m);
+    if(m.rss != m0.rss || m.cow >= m0.cow)
+      fail = 1;
+    c = fail;
+    write(fd[1], &c, 1);
+    exit();
+  }
+  if(read(fd[0], &c, 1) != 1 || c != 0)
+    fail = 1;
+  wait();
+  close(fd[0]);
+  close(fd[1]);
+
+  // child가 끝났으니 write하면 복사 없이 page를 다시 쓴다
+  memstat(&m0);
+  a[2 * PGSIZE] = 9;
+  memstat(&m);
+  printf(1, "parent: rss %d cow %d -> %d\n", m.rss, m0.cow, m.cow);
+  if(m.rss != m0.rss || m.cow >= m0.cow || m.ptp != countptp())
+    fail = 1;
+
+  if(fail)
+    printf(1, "[Test 9] fail\n\n");
+  else
+    printf(1, "[Test 9] pass\n\n");
+  exit();
+}
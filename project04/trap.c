@@ -7,6 +7,7 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "vmstat.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
@@ -14,6 +15,10 @@ extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
 
+// Page fault latency histograms (vmstat.h), one per CPU, added to
+// by the CPU that finishes the fault.
+struct faulthist faulthists[NCPU];
+
 void
 tvinit(void)
 {
@@ -32,10 +37,60 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// The fault being handled is of kind (VM_FAULT_* in vmstat.h).
+// Called by the fault handlers once they know what they are doing.
+void
+countfault(int kind)
+{
+  vmcount(kind);
+  if(myproc())
+    myproc()->faultkind = kind;
+}
+
+// Add a fault of kind that took cycles to this CPU's histogram.
+static void
+faulttime(int kind, unsigned long long cycles)
+{
+  uint c;
+  int b;
+
+  if(kind < VM_FAULT_COPY || kind >= VM_FAULT_COPY + NFAULTKIND)
+    return;
+  b = NFAULTBUCKET - 1;
+  if(cycles >> 32 == 0)
+    for(c = cycles, b = 0; c > 1; c >>= 1)
+      b++;
+  pushcli();
+  faulthists[cpuid()].n[kind - VM_FAULT_COPY][b]++;
+  popcli();
+}
+
+// Add up all CPUs' fault latency histograms into h, and clear them
+// if reset.  A fault finishing meanwhile may be lost or half counted.
+void
+faulthist(struct faulthist *h, int reset)
+{
+  int c, k, b;
+
+  memset(h, 0, sizeof(*h));
+  for(c = 0; c < ncpu; c++){
+    for(k = 0; k < NFAULTKIND; k++){
+      for(b = 0; b < NFAULTBUCKET; b++){
+        h->n[k][b] += faulthists[c].n[k][b];
+        if(reset)
+          faulthists[c].n[k][b] = 0;
+      }
+    }
+  }
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  unsigned long long start;
+  int r;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -47,11 +102,6 @@ trap(struct trapframe *tf)
   }
 
   switch(tf->trapno){
-  case T_PGFLT:
-    CoW_handler();
-    lapiceoi();
-    break;
-
   case T_IRQ0 + IRQ_TIMER:
     if(cpuid() == 0){
       acquire(&tickslock);
@@ -83,6 +133,32 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // 아직 page가 없는 heap 주소면 지금 할당 (lazy sbrk),
+    // read only page에 write하면 CoW로 처리
+    if(myproc() != 0){
+      vmcount(VM_FAULT);
+      start = rdtsc();
+      myproc()->faultkind = 0;
+      // handler가 sleep하는 동안 kswapd나 ksmd가 이 process의 page를
+      // 바꾸지 못하게 한다 (procidle)
+      myproc()->pinned++;
+      r = -1;
+      if(!(tf->err & FEC_PR))
+        r = lazy_handler(tf->err & FEC_WR);
+      else if(tf->err & FEC_WR)
+        r = CoW_handler();
+      myproc()->pinned--;
+      if(r == 0){
+        // handler가 sleep했다면 다른 CPU에서 끝날 수도 있다
+        faulttime(myproc()->faultkind, rdtsc() - start);
+        break;
+      }
+      vmcount(VM_FAULT_FATAL);
+    }
+    // 처리할 수 없는 page fault는 아래 default와 같이 처리
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
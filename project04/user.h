@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct spawn_action;
+struct memstat;
+struct vmstat;
+struct faulthist;
 
 // system calls
 int fork(void);
@@ -29,6 +33,16 @@ int countfp(void);
 int countvp(void);
 int countpp(void);
 int countptp(void);
+int vfork(void);
+int spawn(char*, char**, struct spawn_action*);
+char* hsbrk(int);
+int buddyinfo(int*);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int memstat(struct memstat*);
+int vmstat(struct vmstat*);
+int ksm(int);
+int faulthist(struct faulthist*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -6,6 +6,8 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "swap.h"
+#include "vmstat.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -29,9 +31,182 @@ seginit(void)
   lgdt(c->gdt, sizeof(c->gdt));
 }
 
+// Pending TLB invalidations for one address space.  Callers that
+// change several PTEs record each page with tlb_add() and then call
+// tlb_flush() once: up to TLB_BATCH pages are invalidated one by one
+// with invlpg, beyond that a CR3 reload is cheaper.
+#define TLB_BATCH 32
+
+struct tlbbatch {
+  uint va[TLB_BATCH];
+  int n;
+};
+
+static void
+tlb_add(struct tlbbatch *b, uint va)
+{
+  if(b->n < TLB_BATCH)
+    b->va[b->n] = va;
+  b->n++;
+}
+
+// Invalidate the pages recorded in b.  The TLB only caches the
+// current address space, so nothing is needed for any other pgdir.
+static void
+tlb_flush(struct tlbbatch *b, pde_t *pgdir)
+{
+  int i;
+
+  if(b->n == 0 || myproc() == 0 || myproc()->pgdir != pgdir)
+    return;
+  if(b->n > TLB_BATCH){
+    lcr3(V2P(pgdir));
+    vmcount(VM_TLB_FLUSH);
+  } else {
+    for(i = 0; i < b->n; i++)
+      invlpg((void*)b->va[i]);
+    vmadd(VM_TLB_INVLPG, b->n);
+  }
+  b->n = 0;
+}
+
+// Each process counts its resident pages, how many of those are
+// mapped read-only (copy-on-write, the zero page, cached program
+// pages, read-only mmap), and its page table pages (struct memcount).
+// The functions below that change the current process's own page
+// table keep the counts up to date.  A page table being built for
+// exec or spawn is counted once with memrecount, fork sets the
+// child's counts with memfork, and swap adjusts the counts of the
+// process it takes pages from.
+
+// The current process, if pgdir is its page table.
+static struct proc*
+owner(pde_t *pgdir)
+{
+  struct proc *p = myproc();
+
+  if(p && p->pgdir == pgdir)
+    return p;
+  return 0;
+}
+
+// Add to the memory counts of pgdir's process, if it is current.
+static void
+memadd(pde_t *pgdir, int rss, int cow, int ptp)
+{
+  struct proc *p;
+
+  if((p = owner(pgdir)) == 0)
+    return;
+  p->mem.rss += rss;
+  p->mem.cow += cow;
+  p->mem.ptp += ptp;
+}
+
+// Page tables are shared copy-on-write between parent and child on
+// fork: both page directories point at the same page table page with
+// PTE_W cleared in the PDE, and the page table's reference count says
+// how many page directories use it.  A PDE without PTE_W therefore
+// always means a shared page table; anything that changes a PTE must
+// call ptunshare first.
+//
+// A PDE with PTE_PS maps a 4MB page directly instead of pointing at a
+// page table.  The kernel maps most of physical memory that way, and
+// user processes can ask for 4MB pages (MAXORDER buddy blocks) with
+// hsbrk.  User 4MB pages are shared on fork the same way: PTE_W
+// cleared in both PDEs and the count kept in the 4MB page's first
+// struct page.  walkpgdir must never be used on such a PDE.
+
+// Drop pgdir's reference to the page table at pde.  If it was the
+// last one, free the user pages it maps (if user) and the table.
+static void
+ptfree(pde_t *pde, int user)
+{
+  pte_t *pgtab;
+  uint pa;
+  int i;
+
+  pa = PTE_ADDR(*pde);
+  if(*pde & PTE_PS){
+    // kernel의 4MB mapping은 참조값을 관리하지 않는다
+    *pde = 0;
+    if(user && put_page(pa))
+      hugefree(P2V(pa));
+    return;
+  }
+  *pde = 0;
+  if(!put_page(pa))
+    return;
+  pgtab = (pte_t*)P2V(pa);
+  if(user){
+    for(i = 0; i < NPTENTRIES; i++){
+      if(pgtab[i] & PTE_P)
+        kfree(P2V(PTE_ADDR(pgtab[i])));
+      else if(pgtab[i] & PTE_SWAP)
+        swapput(SWAPSLOT(pgtab[i]));
+    }
+  }
+  freepage((char*)pgtab);
+}
+
+// Give pgdir its own copy of the shared page table at pde, so its
+// PTEs can be changed.  The user pages it maps become shared
+// copy-on-write between the old and new table.
+// Returns -1 if out of memory.
+static int
+ptunshare(pde_t *pgdir, pde_t *pde)
+{
+  pte_t *old, *new;
+  uint pa;
+  int i, n;
+
+  pa = PTE_ADDR(*pde);
+  old = (pte_t*)P2V(pa);
+  if(get_refc(pa) == 1){
+    // 다른 page directory는 이미 자기 page table을 가져갔다.
+    // 쓰기 가능한 PTE는 이제 fault 없이 쓸 수 있다.
+    *pde |= PTE_W;
+    n = 0;
+    for(i = 0; i < NPTENTRIES; i++)
+      if((old[i] & (PTE_P|PTE_W)) == (PTE_P|PTE_W))
+        n++;
+    memadd(pgdir, 0, -n, 0);
+  } else {
+    if((new = (pte_t*)kallocwait(0)) == 0)
+      return -1;
+    for(i = 0; i < NPTENTRIES; i++){
+      if(old[i] & PTE_P){
+        old[i] &= ~PTE_W;
+        if(PTE_ADDR(old[i]) != V2P(zeropage))
+          incr_refc(PTE_ADDR(old[i]));
+      } else if(old[i] & PTE_SWAP)
+        swapdup(SWAPSLOT(old[i]));
+      new[i] = old[i];
+    }
+    *pde = V2P(new) | PTE_P | PTE_W | PTE_U;
+    // 그 사이 다른 쪽이 exit했으면 old의 마지막 참조는 우리다
+    if(put_page(pa)){
+      for(i = 0; i < NPTENTRIES; i++){
+        if(old[i] & PTE_P)
+          kfree(P2V(PTE_ADDR(old[i])));
+        else if(old[i] & PTE_SWAP)
+          swapput(SWAPSLOT(old[i]));
+      }
+      freepage((char*)old);
+    }
+  }
+  // The PDE changed, so every cached translation in its 4MB is stale.
+  if(myproc() && myproc()->pgdir == pgdir){
+    lcr3(V2P(pgdir));
+    vmcount(VM_TLB_FLUSH);
+  }
+  return 0;
+}
+
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
-// create any required page table pages.
+// create any required page table pages, and unshare a
+// copy-on-write page table so the PTE can be written.
 static pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
@@ -39,13 +214,17 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    panic("walkpgdir: 4MB page");
   if(*pde & PTE_P){
+    if(alloc && !(*pde & PTE_W) && ptunshare(pgdir, pde) < 0)
+      return 0;
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kallocwait(1)) == 0)
+      return 0;
+    memadd(pgdir, 0, 0, 1);
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -54,6 +233,72 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   return &pgtab[PTX(va)];
 }
 
+// Iterator over the mappings of an address range, for code that
+// looks at every page of a range.  Calling walkpgdir for each page
+// goes back to the page directory every time and visits 4MB regions
+// with no page table page by page; ptnext steps over those regions
+// at once, so the cost follows the number of page tables in the
+// range, not its size.  Use like
+//
+//   ptstart(&it, pgdir, start, end);
+//   while((pte = ptnext(&it)) != 0)
+//     ... the page at it.va ...
+//
+// A 4MB page is returned once, as its PDE (PTE_PS set), with it.va
+// the first address of it in the range.  The PDE is read again on
+// every call, so the caller may replace the page table (ptunshare).
+struct ptiter {
+  pde_t *pgdir;
+  uint va;        // address of the entry ptnext returned last
+  uint next;      // address ptnext looks at next
+  uint end;
+  pde_t *pde;     // page directory entry of va
+};
+
+static void
+ptstart(struct ptiter *it, pde_t *pgdir, uint start, uint end)
+{
+  it->pgdir = pgdir;
+  it->next = PGROUNDDOWN(start);
+  it->end = end;
+}
+
+// Make ptnext go on at the 4MB region after the one holding it->va.
+static void
+ptskip(struct ptiter *it)
+{
+  it->next = PGADDR(PDX(it->va) + 1, 0, 0);
+  if(it->next <= it->va)   // 4GB를 넘어가면 0이 된다
+    it->next = it->end;
+}
+
+// Return the entry that maps the next address in the range that is
+// in a page table or a 4MB page, or 0 at the end of the range.
+static pte_t*
+ptnext(struct ptiter *it)
+{
+  pde_t *pde;
+
+  while(it->next < it->end){
+    it->va = it->next;
+    pde = &it->pgdir[PDX(it->va)];
+    if(!(*pde & PTE_P)){
+      ptskip(it);
+      continue;
+    }
+    it->pde = pde;
+    if(*pde & PTE_PS){
+      ptskip(it);
+      return pde;
+    }
+    it->next = it->va + PGSIZE;
+    if(it->next == 0)
+      it->next = it->end;
+    return &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(it->va)];
+  }
+  return 0;
+}
+
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
@@ -71,6 +316,8 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
     if(*pte & PTE_P)
       panic("remap");
     *pte = pa | perm | PTE_P;
+    if((uint)a < KERNBASE)
+      memadd(pgdir, 1, !(perm & PTE_W), 0);
     if(a == last)
       break;
     a += PGSIZE;
@@ -79,6 +326,34 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
   return 0;
 }
 
+// Map size bytes of kernel memory at va to pa, using a 4MB page for
+// every 4MB-aligned piece and page tables only for the rest.
+static int
+mapkvm(pde_t *pgdir, uint va, uint size, uint pa, int perm)
+{
+  uint n;
+
+  while(size > 0){
+    if(va % HUGEPGSIZE == 0 && pa % HUGEPGSIZE == 0 && size >= HUGEPGSIZE){
+      if(pgdir[PDX(va)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+      n = HUGEPGSIZE;
+    } else {
+      // 다음 4MB 경계까지는 4KB page로
+      n = HUGEPGSIZE - va % HUGEPGSIZE;
+      if(n > size)
+        n = size;
+      if(mappages(pgdir, (void*)va, n, pa, perm) < 0)
+        return -1;
+    }
+    va += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -92,13 +367,18 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
+//   data..KERNBASE+phystop: mapped to V2P(data)..phystop,
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
+// Everything 4MB-aligned is mapped with 4MB pages, so only the first
+// 4MB (I/O space and kernel text, which need separate permissions)
+// uses a page table.
+//
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and the end of physical memory (phystop, found by
+// kinit1 from the BIOS memory map and at most PHYSMAX)
+// (directly addressable from end..P2V(phystop)).
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -110,7 +390,7 @@ static struct kmap {
 } kmap[] = {
  { (void*)KERNBASE, 0,             EXTMEM,    PTE_W}, // I/O space
  { (void*)KERNLINK, V2P(KERNLINK), V2P(data), 0},     // kern text+rodata
- { (void*)data,     V2P(data),     PHYSTOP,   PTE_W}, // kern data+memory
+ { (void*)data,     V2P(data),     0,         PTE_W}, // kern data+memory
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
@@ -121,14 +401,11 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kzalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
+    if(mapkvm(pgdir, (uint)k->virt, k->phys_end - k->phys_start,
+              (uint)k->phys_start, k->perm) < 0) {
       freevm(pgdir);
       return 0;
     }
@@ -140,6 +417,12 @@ setupkvm(void)
 void
 kvmalloc(void)
 {
+  struct kmap *k;
+
+  // 물리 메모리 크기는 부팅할 때 알게 된다 (kinit1)
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(k->virt == data)
+      k->phys_end = phystop;
   kpgdir = setupkvm();
   switchkvm();
 }
@@ -186,36 +469,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, P2V(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,13 +489,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kallocwait(1);
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -255,26 +512,76 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 int
 deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
-  pte_t *pte;
+  pde_t *pde;
+  pte_t *pte, *pgtab;
   uint a, pa;
+  int i, n, rss, cow, ptp;
+  struct tlbbatch tlb;
+  struct ptiter it;
 
   if(newsz >= oldsz)
     return oldsz;
+  tlb.n = 0;
+  rss = cow = ptp = 0;
 
-  a = PGROUNDUP(newsz);
-  for(; a  < oldsz; a += PGSIZE){
-    pte = walkpgdir(pgdir, (char*)a, 0);
-    if(!pte)
-      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
-    else if((*pte & PTE_P) != 0){
+  ptstart(&it, pgdir, PGROUNDUP(newsz), oldsz);
+  while((pte = ptnext(&it)) != 0){
+    a = it.va;
+    pde = it.pde;
+    if(*pde & PTE_PS){
+      // 4MB page는 통째로만 free한다.  일부만 줄이면 sz 밖의 부분도
+      // 계속 mapping된 채로 두었다가, 시작 주소까지 줄일 때 free한다.
+      if(a % HUGEPGSIZE == 0){
+        rss += NPTENTRIES;
+        if(!(*pde & PTE_W))
+          cow += NPTENTRIES;
+        ptfree(pde, 1);
+        tlb_add(&tlb, a);
+      }
+      continue;
+    }
+    if(!(*pde & PTE_W)){
+      // 공유 중인 page table: 4MB 전체를 지우면 참조만 놓고,
+      // 일부만 지우면 자기 copy를 만든 뒤 지운다
+      if(a % (PGSIZE*NPTENTRIES) == 0 && oldsz - a >= PGSIZE*NPTENTRIES){
+        pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+        for(n = 0, i = 0; i < NPTENTRIES; i++)
+          if(pgtab[i] & PTE_P)
+            n++;
+        rss += n;
+        cow += n;
+        ptp++;
+        ptfree(pde, 1);
+        tlb.n = TLB_BATCH + 1;  // 4MB가 통째로 바뀌었으므로 CR3 reload
+        ptskip(&it);
+        continue;
+      }
+      if(ptunshare(pgdir, pde) < 0){
+        // 메모리가 없으면 남은 page는 exit할 때 freevm이 정리한다
+        ptskip(&it);
+        continue;
+      }
+      // page table이 바뀌었다
+      pte = &((pte_t*)P2V(PTE_ADDR(*pde)))[PTX(a)];
+    }
+    if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
+      rss++;
+      if(!(*pte & PTE_W))
+        cow++;
+      *pte = 0;
+      tlb_add(&tlb, a);
       kfree(v);
+    } else if(*pte & PTE_SWAP){
+      swapput(SWAPSLOT(*pte));
       *pte = 0;
     }
   }
+  tlb_flush(&tlb, pgdir);
+  memadd(pgdir, -rss, -cow, -ptp);
   return newsz;
 }
 
@@ -287,16 +594,183 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
-      char * v = P2V(PTE_ADDR(pgdir[i]));
-      kfree(v);
-    }
+    if(pgdir[i] & PTE_P)
+      ptfree(&pgdir[i], i < PDX(KERNBASE));
   }
   kfree((char*)pgdir);
 }
 
+// Map 4MB pages to grow process from oldsz to newsz, starting at the
+// first 4MB boundary at or above oldsz.  The space between oldsz and
+// that boundary is left to lazy_handler.  Returns the new size,
+// newsz rounded up to 4MB, or 0 on error.
+int
+hugeallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  char *mem;
+  pde_t *pde;
+  uint a;
+
+  newsz = HUGEPGROUNDUP(newsz);
+  if(newsz > KERNBASE || newsz <= oldsz)
+    return 0;
+
+  for(a = HUGEPGROUNDUP(oldsz); a < newsz; a += HUGEPGSIZE){
+    pde = &pgdir[PDX(a)];
+    if(*pde & PTE_PS)
+      panic("hugeallocuvm: remap");
+    // sz 위에 비어 있는 page table이 남아 있을 수 있다
+    if(*pde & PTE_P){
+      ptfree(pde, 1);
+      memadd(pgdir, 0, 0, -1);
+      if(myproc() && myproc()->pgdir == pgdir){
+        lcr3(V2P(pgdir));
+        vmcount(VM_TLB_FLUSH);
+      }
+    }
+    if((mem = hugealloc()) == 0){
+      deallocuvm(pgdir, a, HUGEPGROUNDUP(oldsz));
+      return 0;
+    }
+    memset(mem, 0, HUGEPGSIZE);
+    *pde = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+    memadd(pgdir, NPTENTRIES, 0, 0);
+  }
+  return newsz;
+}
+
+// Map the page mem at user address va in pgdir, for mmapfault.
+// Returns -1 if out of memory.
+int
+mapuvm(pde_t *pgdir, uint va, char *mem, int perm)
+{
+  return mappages(pgdir, (char*)va, PGSIZE, V2P(mem), perm);
+}
+
+// Copy the mappings of [start, end) from pgdir to d, for fork of an
+// mmap region.  With shared, both map the same pages with the same
+// permissions; otherwise writable pages become copy-on-write in
+// both.  Returns the number of pages copied, or -1 if out of memory.
+int
+copyrange(pde_t *pgdir, pde_t *d, uint start, uint end, int shared)
+{
+  pte_t *pte, *npte;
+  uint a, pa;
+  int n;
+  struct tlbbatch tlb;
+  struct ptiter it;
+
+  tlb.n = 0;
+  n = 0;
+  ptstart(&it, pgdir, start, end);
+  while((pte = ptnext(&it)) != 0){
+    a = it.va;
+    // mmap 영역에는 4MB page가 없다
+    if(!(*pte & PTE_P) || (*pte & PTE_PS))
+      continue;
+    if((npte = walkpgdir(d, (char*)a, 1)) == 0){
+      tlb_flush(&tlb, pgdir);
+      return -1;
+    }
+    if(!shared && (*pte & PTE_W)){
+      *pte &= ~PTE_W;
+      tlb_add(&tlb, a);
+    }
+    pa = PTE_ADDR(*pte);
+    if(pa != V2P(zeropage))
+      incr_refc(pa);
+    *npte = *pte;
+    n++;
+  }
+  tlb_flush(&tlb, pgdir);
+  return n;
+}
+
+// Find the first 4KB page in [*va, end) of pgdir whose PTE has all
+// of flags set.  Sets *va to its address and returns its kernel
+// address, or returns 0 if there is none.
+static char*
+nextpte(pde_t *pgdir, uint *va, uint end, uint flags)
+{
+  pte_t *pte;
+  struct ptiter it;
+
+  ptstart(&it, pgdir, *va, end);
+  while((pte = ptnext(&it)) != 0){
+    if((*pte & (flags|PTE_PS)) == flags){
+      *va = it.va;
+      return (char*)P2V(PTE_ADDR(*pte));
+    }
+  }
+  return 0;
+}
+
+// The first page in [*va, end) of pgdir that is mapped, as nextpte.
+char*
+nextpage(pde_t *pgdir, uint *va, uint end)
+{
+  return nextpte(pgdir, va, end, PTE_P);
+}
+
+// The first page in [*va, end) of pgdir that is mapped and has been
+// written to since (PTE_D), as nextpte.
+char*
+nextdirty(pde_t *pgdir, uint *va, uint end)
+{
+  return nextpte(pgdir, va, end, PTE_P|PTE_D);
+}
+
+// One step of the swap clock over p's user pages, from *hand up
+// to p->sz.  A page used since the last pass (PTE_A set) just has
+// PTE_A cleared.  Otherwise, if only this PTE refers to it, it is
+// unmapped and recorded in v, and its PTE points at a newly
+// allocated swap slot.  Pages in shared page tables, 4MB pages and
+// the zero page are left alone.  Stops after n victims, at sz, or
+// when swap is full, and leaves *hand where it stopped.  Returns the
+// number of victims, which no longer count as resident in p.  No
+// process using p's page table may be running (the caller holds
+// ptable.lock), so no TLB holds its entries.
+int
+swapscan(struct proc *p, uint *hand, struct victim *v, int n)
+{
+  pte_t *pte;
+  uint pa;
+  int nv, slot;
+  struct ptiter it;
+
+  nv = 0;
+  ptstart(&it, p->pgdir, *hand, p->sz);
+  while(nv < n && (pte = ptnext(&it)) != 0){
+    if((*it.pde & PTE_PS) || !(*it.pde & PTE_W)){
+      ptskip(&it);
+      continue;
+    }
+    if(!(*pte & PTE_P) || !(*pte & PTE_U))
+      continue;
+    pa = PTE_ADDR(*pte);
+    if(pa == V2P(zeropage) || get_refc(pa) != 1)
+      continue;
+    if(*pte & PTE_A){
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if((slot = swapalloc()) < 0){
+      it.next = it.va;   // 다음에 이 page부터 다시 본다
+      break;
+    }
+    v[nv].page = P2V(pa);
+    v[nv].slot = slot;
+    nv++;
+    p->mem.rss--;
+    if(!(*pte & PTE_W))
+      p->mem.cow--;
+    *pte = SWAPPTE(slot) | (*pte & (PTE_W|PTE_U));
+  }
+  *hand = it.next;
+  return nv;
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -312,47 +786,36 @@ clearpteu(pde_t *pgdir, char *uva)
 
 // Given a parent process's page table, create a copy
 // of it for a child.
+// User page tables and 4MB pages are not copied: parent and child
+// share them read-only (see ptunshare and CoW_handler), so fork only
+// costs a page directory and the kernel mappings.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
-  uint pa, i, flags;
-  //char *mem;
+  uint i;
+  int shared;
 
   if((d = setupkvm()) == 0)
     return 0;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-
-    // read only로 write를 불가능하게 설정
-    *pte = (~ PTE_W) & *pte;
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-
-    // if((mem = kalloc()) == 0)
-    //   goto bad;
-    // memmove(mem, (char*)P2V(pa), PGSIZE);
-
-    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0) {
-      //kfree(mem);
-      goto bad;
-    }
-
-    // ref cnt 1 증가
-    incr_refc(pa);
+  shared = 0;
+  for(i = 0; i < PDX(KERNBASE) && PGADDR(i, 0, 0) < sz; i++){
+    if(!(pgdir[i] & PTE_P))
+      continue;
+    // page table(또는 4MB page)을 read only로 공유하고 참조값 1 증가
+    pgdir[i] &= ~PTE_W;
+    d[i] = pgdir[i];
+    incr_refc(PTE_ADDR(pgdir[i]));
+    vmcount(VM_FORK_PT);
+    shared = 1;
+  }
+  // 부모의 PDE가 바뀌었으므로 TLB flush
+  if(shared && myproc() && myproc()->pgdir == pgdir){
+    lcr3(V2P(pgdir));
+    vmcount(VM_TLB_FLUSH);
   }
-  lcr3(V2P(pgdir));   // flush
   return d;
-
-bad:
-  freevm(d);
-  lcr3(V2P(pgdir));
-  return 0;
 }
 
 //PAGEBREAK!
@@ -360,9 +823,18 @@ bad:
 char*
 uva2ka(pde_t *pgdir, char *uva)
 {
+  pde_t *pde;
   pte_t *pte;
 
+  pde = &pgdir[PDX(uva)];
+  if(*pde & PTE_PS){
+    if((*pde & PTE_U) == 0)
+      return 0;
+    return (char*)P2V(PTE_ADDR(*pde)) + ((uint)uva & (HUGEPGSIZE-1));
+  }
   pte = walkpgdir(pgdir, uva, 0);
+  if(pte == 0)
+    return 0;
   if((*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
@@ -370,6 +842,38 @@ uva2ka(pde_t *pgdir, char *uva)
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
+// Touch the user pages in [va, va+n) of the current process, so
+// that any lazy or swapped-out page is faulted in now, while no
+// locks are held.  With write, each page is written to (with the
+// byte already there), so that zero, copy-on-write and shared page
+// table faults are taken now too.  Pipe and console code copy to
+// and from user memory under a spin lock, where a fault must not
+// sleep and so may fail for want of memory.  The process is pinned
+// for the whole system call (procidle), so kswapd cannot take the
+// pages away again while it sleeps in there.
+void
+prefault(char *va, int n, int write)
+{
+  char *a, *last;
+  volatile char *b;
+
+  if(n <= 0)
+    return;
+  a = (char*)PGROUNDDOWN((uint)va);
+  last = (char*)PGROUNDDOWN((uint)va + n - 1);
+  for(;;){
+    // 첫 page는 buffer 앞쪽을 건드리지 않도록 va부터
+    b = a < va ? va : a;
+    if(write)
+      *b = *b;
+    else
+      (void)*b;
+    if(a == last)
+      break;
+    a += PGSIZE;
+  }
+}
+
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.
@@ -403,116 +907,298 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 //PAGEBREAK!
 // Blank page.
 
+// 아직 mapping되지 않은 heap/BSS page에 접근했을 때 page fault 발생 시 처리하는 곳
+// sbrk와 exec는 주소 공간만 늘리므로, 여기서 page를 채운다.
+// read면 공유 zero page를 read only로 mapping하고 (write할 때 CoW_handler가
+// 복사), write면 바로 0으로 채운 page를 할당한다.
+// swap으로 내보낸 page면 swapin으로, 실행 파일 내용이 있는 page면
+// execfault로 읽어 온다.
+// sz 위의 주소는 mmapfault가 처리한다.
+// 처리했으면 0, 처리할 수 없는 fault면 -1을 return
+int
+lazy_handler(int write)
+{
+  struct proc *p = myproc();
+  uint va = rcr2();
+  char *mem;
+  pte_t *pte;
+  int r;
+
+  // sz 위는 mmap 영역
+  if(va >= PGROUNDUP(p->sz))
+    return mmapfault(va, write);
+  va = PGROUNDDOWN(va);
+
+  pte = walkpgdir(p->pgdir, (void*)va, 0);
+  if(pte && (*pte & PTE_P))
+    return -1;
+  if(pte && (*pte & PTE_SWAP)){
+    // 공유 page table이면 먼저 자기 copy를 만들어서, 읽어 온 page가
+    // 이 process에만 mapping되게 한다 (memory counter가 맞도록)
+    if((pte = walkpgdir(p->pgdir, (void*)va, 1)) == 0 || swapin(pte) < 0)
+      return -1;
+    countfault(VM_FAULT_SWAPIN);
+    return 0;
+  }
+  if((r = execfault(va, write)) != 1)
+    return r;
+
+  countfault(VM_FAULT_ZERO);
+  if(!write)
+    return mappages(p->pgdir, (char*)va, PGSIZE, V2P(zeropage), PTE_U);
+
+  if((mem = kallocwait(1)) == 0){
+    cprintf("lazy_handler: out of memory\n");
+    return -1;
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// 공유 중인 4MB page에 write: 4KB page와 같은 방식으로,
+// 혼자 쓰고 있으면 PTE_W만 켜고 아니면 4MB 전체를 복사한다
+static int
+hugeCoW(pde_t *pde, uint va)
+{
+  uint pa = PTE_ADDR(*pde);
+  char *mem;
+
+  if(!(*pde & PTE_U) || (*pde & PTE_W))
+    return -1;
+
+  if(get_refc(pa) == 1){
+    *pde |= PTE_W;
+    invlpg((void*)va);
+    vmcount(VM_TLB_INVLPG);
+    countfault(VM_FAULT_REUSE);
+    myproc()->mem.cow -= NPTENTRIES;
+    return 0;
+  }
+  if((mem = hugealloc()) == 0){
+    cprintf("CoW_handler: out of 4MB pages\n");
+    return -1;
+  }
+  memmove(mem, (char*)P2V(pa), HUGEPGSIZE);
+  *pde = V2P(mem) | PTE_P | PTE_W | PTE_U | PTE_PS;
+  invlpg((void*)va);
+  vmcount(VM_TLB_INVLPG);
+  countfault(VM_FAULT_COPY);
+  myproc()->mem.cow -= NPTENTRIES;
+  if(put_page(pa))
+    hugefree(P2V(pa));
+  return 0;
+}
+
+// Fault-around for CoW_handler, which has just made the page at va
+// writable for p.  Does the same for the other copy-on-write pages
+// in the aligned window of COWAROUND pages around va (all in one page
+// table), so that a process writing its way through memory after
+// fork takes one fault per window instead of one per page.  A page
+// is made writable in place if p holds the only reference and copied
+// otherwise.  The zero page, program pages that may still be shared
+// through the page cache, and pages there is no free memory for are
+// left to fault on their own.  Then flushes the TLB once for va and
+// all the pages it changed.
+static void
+cowaround(struct proc *p, uint va)
+{
+  struct tlbbatch tlb;
+  pte_t *pgtab, *pte;
+  uint a, start, pa;
+  char *mem;
+
+  tlb.n = 0;
+  tlb_add(&tlb, va);
+  start = va & ~(COWAROUND*PGSIZE - 1);
+  pgtab = (pte_t*)P2V(PTE_ADDR(p->pgdir[PDX(va)]));
+  for(a = start; a < start + COWAROUND*PGSIZE; a += PGSIZE){
+    pte = &pgtab[PTX(a)];
+    if(a == va || (*pte & (PTE_P|PTE_U|PTE_W)) != (PTE_P|PTE_U))
+      continue;
+    // mmap 영역은 PROT_WRITE인 곳만
+    if(a >= p->sz && vmalimit(p, a, 1) == 0)
+      continue;
+    pa = PTE_ADDR(*pte);
+    if(pa == V2P(zeropage))
+      continue;
+    if(get_refc(pa) == 1)
+      *pte |= PTE_W;
+    else {
+      // 아직 안 쓴 program page를 미리 복사하면 공유가 깨진다
+      if(a < p->sz && execpage(p, a))
+        continue;
+      if((mem = kalloc()) == 0)
+        break;
+      memmove(mem, (char*)P2V(pa), PGSIZE);
+      *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+      kfree((char*)P2V(pa));
+    }
+    p->mem.cow--;
+    vmcount(VM_COW_AROUND);
+    tlb_add(&tlb, a);
+  }
+  tlb_flush(&tlb, p->pgdir);
+}
+
 // read only로 되어있는 곳에 write하려고 할때 page fault 발생 시 처리하는 곳
-void 
+// 처리했으면 0, CoW page가 아니면 -1을 return
+int
 CoW_handler(void){
   
   // page fault가 발생한 가상주소 가져오기
-  int va = rcr2();
+  uint va = rcr2();
 
   pte_t *pte;
   
-  pte = walkpgdir(myproc()->pgdir, (void*)va, 0);
+  if(va >= KERNBASE)
+    return -1;
+  // mmap 영역은 PROT_WRITE로 mapping된 곳에만 write할 수 있다
+  if(va >= myproc()->sz && vmalimit(myproc(), va, 1) == 0)
+    return -1;
 
-  if(pte == 0 || !(*pte) || va >= KERNBASE || !PTE_U || !PTE_P)  
-  { 
-    myproc()->killed = 1;
-    return;
+  pde_t *pde = &myproc()->pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return hugeCoW(pde, va);
+
+  // 공유 중인 page table이면 먼저 자기 copy를 만든다
+  if((*pde & PTE_P) && !(*pde & PTE_W) && ptunshare(myproc()->pgdir, pde) < 0){
+    cprintf("CoW_handler: out of memory\n");
+    return -1;
   }
 
+  pte = walkpgdir(myproc()->pgdir, (void*)va, 0);
+
+  // 보호 페이지(PTE_U 없음) 등은 CoW 대상이 아니다
+  if(pte == 0 || !(*pte & PTE_P) || !(*pte & PTE_U))
+    return -1;
+
   // 물리 주소 가져오기
   int pa = PTE_ADDR(*pte);          
+
+  // zero page에 처음 write: 복사할 필요 없이 0으로 채운 page를 할당
+  if(pa == V2P(zeropage)){
+    char *mem = kallocwait(1);
+
+    if(mem == 0){
+      cprintf("CoW_handler: out of memory\n");
+      return -1;
+    }
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+    countfault(VM_FAULT_ZERO);
+    myproc()->mem.cow--;
+    cowaround(myproc(), va);
+    return 0;
+  }
+
   int cnt_ref = get_refc(pa);
 
   if(cnt_ref == 1){
     // 읽기전용을 쓰기도 가능하도록 변경하기
     *pte = PTE_W | *pte;
-    lcr3(V2P(myproc()->pgdir));  // 페이지 테이블 변경 사항을 반영하기 위해 TLB 플러시
-    return;
+    countfault(VM_FAULT_REUSE);
+    myproc()->mem.cow--;
+    cowaround(myproc(), va);
+    return 0;
 
   }
   else if(cnt_ref > 1){
     // 새로운 메모리 할당하기
-    char* mem = kalloc();
+    char* mem = kallocwait(0);
 
     if(mem == 0){
-      myproc()->killed = 1;
-      return;
+      cprintf("CoW_handler: out of memory\n");
+      return -1;
     }
     memmove(mem, (char*)P2V(pa), PGSIZE);
     // 새로운 page table entry 설정
     *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
-    // 부모 메모리 참조값 감소
-    decr_refc(pa);
-    lcr3(V2P(myproc()->pgdir));
-    return;
+    countfault(VM_FAULT_COPY);
+    myproc()->mem.cow--;
+    // 원래 page의 참조값 감소
+    // (그 사이 다른 프로세스가 먼저 복사해 갔다면 여기서 free된다)
+    // TLB는 cowaround가 flush하고, 그 전에는 user code가 돌지 않는다
+    kfree((char*)P2V(pa));
+    cowaround(myproc(), va);
+    return 0;
 
   }
   else{
     // cnt_ref가 < 1 이라는 것은 더이상 아무도 참조 x
     panic("Error!! : Illefal reference Count");
   }
-  lcr3(V2P(myproc()->pgdir));
-
 }
 
+// 예전에는 p->sz까지 page table을 훑어서 셌지만, 이제는
+// page table이 바뀔 때마다 고쳐 두는 counter를 읽는다.
+// countvp와 countpp는 둘 다 mapping된 page 수 (4MB page는 1024개로 센다)
 int
-countvp(void){
-  struct proc *p = myproc(); 
-  pde_t *pgdir = p->pgdir;
-  int count = 0;
-
-  int size = p->sz;
-
-  for (int va = 0; va < size; va += PGSIZE) {
-     // 주어진 가상 주소에 대한 page table entry 가져오기
-      pte_t *pte = walkpgdir(pgdir, (void *)va, 0);
-      // page table entry가 존재하고 유효하다면 count
-      if (pte && (*pte & PTE_P)) {
-          count++;
-      }
-  }
-  return count;
-
+countvp(void)
+{
+  return myproc()->mem.rss;
 }
 
 int
-countpp(void){
-  struct proc *p = myproc(); 
-  int size = p->sz;
-  pde_t *pgdir = p->pgdir;
-  int count = 0;
-
-  //char *start = (char *)PGROUNDDOWN(0);
-  char *end = (char *)PGROUNDDOWN(size -1);
-
-  pte_t * pte;
-
-  // 가상 주소 공간을 순회
-    for (char *a = 0; a <= (char *)end; a += PGSIZE) {
-        // 가상 주소에 해당하는 pte 가져오기
-        if ((pte = walkpgdir(pgdir, (char *)a, 0)) != 0 && (*pte & PTE_P)) {
-            count++;
-        }
-    }
-
-    return count;
+countpp(void)
+{
+  return myproc()->mem.rss;
 }
 
 // 프로세스의 페이지 테이블에 의해 할당된 페이지 수를 반환하는 함수
+// (page directory 포함)
 int
-countptp(void) {
-    struct proc *p = myproc(); 
-  
-    pde_t *pgdir; 
-    pgdir = p ->pgdir;
+countptp(void)
+{
+  return myproc()->mem.ptp;
+}
 
-    int count = 1; 
+// Count the page table pages of pgdir, including pgdir itself.
+// A 4MB page (PTE_PS) has no page table.
+static int
+ptpages(pde_t *pgdir)
+{
+  int i, n;
 
-    for(int i = 0; i < NPDENTRIES; i++){
-      if(pgdir[i] & PTE_P){
-          count++;
-      }
-    }
-  return count;
-}
\ No newline at end of file
+  n = 1;
+  for(i = 0; i < NPDENTRIES; i++)
+    if((pgdir[i] & PTE_P) && !(pgdir[i] & PTE_PS))
+      n++;
+  return n;
+}
+
+// Set p's memory counts by walking its page table.  Used once for a
+// new image (userinit, exec, spawn), when the page table is small;
+// after that the counts are kept up to date as it changes.
+void
+memrecount(struct proc *p)
+{
+  pte_t *pte;
+  struct ptiter it;
+  int n;
+
+  p->mem.rss = p->mem.cow = 0;
+  p->mem.ptp = ptpages(p->pgdir);
+  ptstart(&it, p->pgdir, 0, KERNBASE);
+  while((pte = ptnext(&it)) != 0){
+    if(!(*pte & PTE_P))
+      continue;
+    n = (*pte & PTE_PS) ? NPTENTRIES : 1;
+    p->mem.rss += n;
+    if(!(*it.pde & PTE_W) || !(*pte & PTE_W))
+      p->mem.cow += n;
+  }
+}
+
+// Memory counts for fork.  np starts with p's resident pages, and in
+// both every one of them is now copy-on-write, except the wshared
+// pages of writable shared mmap regions.  np->pgdir must be set up.
+void
+memfork(struct proc *np, struct proc *p, int wshared)
+{
+  np->mem.rss = p->mem.rss;
+  np->mem.cow = p->mem.cow = p->mem.rss - wshared;
+  vmadd(VM_FORK_PAGES, p->mem.rss - wshared);
+  np->mem.ptp = ptpages(np->pgdir);
+}
@@ -0,0 +1,91 @@
+// vmstat: print system-wide virtual memory events per interval.
+//
+//   vmstat [ticks [count]]
+//   vmstat -l
+//
+// Samples the kernel's counters every ticks clock ticks (default 100,
+// one second) and prints how many of each event happened in between,
+// count times (default forever).  The first sample counts since boot.
+// Many cow copies point at fork-heavy work, alloc fail at memory
+// pressure, and a high flush count at TLB flush storms.
+//
+// With -l, prints how long page faults of each kind took since the
+// last vmstat -l, as counts per power of two of CPU cycles, and
+// starts counting again.
+
+#include "types.h"
+#include "user.h"
+#include "vmstat.h"
+
+struct vmstat prev, cur;
+struct faulthist hist;
+
+char *kinds[NFAULTKIND] = {
+  "cow copy", "cow reuse", "zero", "file", "swapin",
+};
+
+// 지난 sample 이후 늘어난 값
+uint
+delta(int i)
+{
+  return cur.n[i] - prev.n[i];
+}
+
+void
+latency(void)
+{
+  int k, b;
+
+  if(faulthist(&hist, 1) < 0){
+    printf(2, "vmstat: failed\n");
+    exit();
+  }
+  for(k = 0; k < NFAULTKIND; k++){
+    printf(1, "%s:", kinds[k]);
+    for(b = 0; b < NFAULTBUCKET; b++)
+      if(hist.n[k][b])
+        printf(1, " 2^%d %d", b, hist.n[k][b]);
+    printf(1, "\n");
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ticks, count;
+
+  if(argc > 1 && strcmp(argv[1], "-l") == 0){
+    latency();
+    exit();
+  }
+  ticks = argc > 1 ? atoi(argv[1]) : 100;
+  count = argc > 2 ? atoi(argv[2]) : -1;
+  if(ticks <= 0){
+    printf(2, "usage: vmstat [ticks [count]] | vmstat -l\n");
+    exit();
+  }
+
+  for(;;){
+    if(vmstat(&cur) < 0){
+      printf(2, "vmstat: failed\n");
+      exit();
+    }
+    printf(1, "fault %d: cow copy %d reuse %d, zero %d, file %d, "
+           "swapin %d, fatal %d\n",
+           delta(VM_FAULT), delta(VM_FAULT_COPY), delta(VM_FAULT_REUSE),
+           delta(VM_FAULT_ZERO), delta(VM_FAULT_FILE),
+           delta(VM_FAULT_SWAPIN), delta(VM_FAULT_FATAL));
+    printf(1, "  kalloc %d kfree %d fail %d, tlb flush %d invlpg %d, "
+           "fork pt %d pages %d\n",
+           delta(VM_KALLOC), delta(VM_KFREE), delta(VM_KALLOC_FAIL),
+           delta(VM_TLB_FLUSH), delta(VM_TLB_INVLPG),
+           delta(VM_FORK_PT), delta(VM_FORK_PAGES));
+    printf(1, "  cow around %d, ksm merged %d\n",
+           delta(VM_COW_AROUND), delta(VM_KSM_MERGE));
+    prev = cur;
+    if(count > 0 && --count == 0)
+      break;
+    sleep(ticks);
+  }
+  exit();
+}
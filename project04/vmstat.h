@@ -0,0 +1,34 @@
+// System-wide virtual memory event counters, returned by vmstat().
+// The kernel keeps one set per CPU and vmstat() adds them up; they
+// only go up, so a tool samples twice and prints the difference.
+#define VM_FAULT        0   // page faults from user space
+#define VM_FAULT_COPY   1   // CoW write, page copied
+#define VM_FAULT_REUSE  2   // CoW write, last reference, made writable
+#define VM_FAULT_ZERO   3   // demand-zero page (or the zero page on read)
+#define VM_FAULT_FILE   4   // page read from a program or mapped file
+#define VM_FAULT_SWAPIN 5   // page read back from swap
+#define VM_FAULT_FATAL  6   // fault that killed the process
+#define VM_KALLOC       7   // pages handed out by kalloc
+#define VM_KFREE        8   // pages put back on a free list
+#define VM_KALLOC_FAIL  9   // kalloc found no free page
+#define VM_TLB_FLUSH    10  // full TLB flushes (CR3 reload) outside switchuvm
+#define VM_TLB_INVLPG   11  // single-page invalidations
+#define VM_FORK_PT      12  // page tables (or 4MB pages) shared by fork
+#define VM_FORK_PAGES   13  // resident pages fork left copy-on-write
+#define VM_KSM_MERGE    14  // pages freed by same-page merging
+#define VM_COW_AROUND   15  // CoW pages resolved by fault-around
+#define NVMSTAT         16
+
+struct vmstat {
+  uint n[NVMSTAT];
+};
+
+// Page fault latency, from faulthist().  n[k][b] counts handled
+// faults of kind VM_FAULT_COPY+k that took between 2^b and 2^(b+1)
+// CPU cycles, from entering trap() to leaving the handler.
+#define NFAULTKIND  5   // VM_FAULT_COPY .. VM_FAULT_SWAPIN
+#define NFAULTBUCKET 32
+
+struct faulthist {
+  uint n[NFAULTKIND][NFAULTBUCKET];
+};
@@ -130,6 +130,17 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically add v to *addr and return the old value.
+static inline ushort
+xaddw(volatile ushort *addr, ushort v)
+{
+  asm volatile("lock; xaddw %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return v;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -138,12 +149,29 @@ rcr2(void)
   return val;
 }
 
+// Invalidate the TLB entry for the page containing va,
+// in the current address space only.
+static inline void
+invlpg(void *va)
+{
+  asm volatile("invlpg (%0)" : : "r" (va) : "memory");
+}
+
 static inline void
 lcr3(uint val)
 {
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+// CPU cycle counter.  Not synchronized exactly between CPUs.
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().